@@ -1,5 +1,7 @@
 SRC +=	host.c \
+	idle_rate.c \
 	keyboard.c \
+	ghost.c \
 	command.c \
 	layer.c \
 	timer.c \
@@ -28,6 +30,30 @@ ifdef NKRO_ENABLE
     OPT_DEFS += -DNKRO_ENABLE
 endif
 
+ifdef POWER_SAVE_ENABLE
+    SRC += power.c
+    OPT_DEFS += -DPOWER_SAVE_ENABLE
+endif
+
+ifdef LAYER_CACHE_ENABLE
+    OPT_DEFS += -DLAYER_CACHE_ENABLE
+endif
+
+ifdef KEYMAP_PACK_ENABLE
+    SRC += keymap_pack.c
+    OPT_DEFS += -DKEYMAP_PACK_ENABLE
+endif
+
+ifdef KEYMAP_OVERLAY_ENABLE
+    SRC += keymap_overlay.c
+    OPT_DEFS += -DKEYMAP_OVERLAY_ENABLE
+endif
+
+ifdef BINLOG_ENABLE
+    SRC += binlog.c
+    OPT_DEFS += -DBINLOG_ENABLE
+endif
+
 ifdef $(or MOUSEKEY_ENABLE, PS2_MOUSE_ENABLE)
     OPT_DEFS += -DMOUSE_ENABLE
 endif
@@ -0,0 +1,41 @@
+/*
+Copyright 2011 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include "sendchar.h"
+#include "print.h"
+#include "binlog.h"
+
+
+static inline void hex16(uint16_t i)
+{
+    for (int8_t s = 12; s >= 0; s -= 4) {
+        uint8_t c = (i >> s) & 0x0F;
+        sendchar(c + ((c < 10) ? '0' : 'A' - 10));
+    }
+}
+
+void binlog(uint16_t id, uint8_t argc, uint16_t a, uint16_t b)
+{
+    if (!print_enable) return;
+    sendchar('@');
+    hex16(id);
+    if (argc > 0) hex16(a);
+    if (argc > 1) hex16(b);
+    sendchar('\r');
+    sendchar('\n');
+}
@@ -0,0 +1,47 @@
+/*
+Copyright 2011 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BINLOG_H
+#define BINLOG_H 1
+
+#include <stdint.h>
+
+
+/*
+ * Deferred-format log
+ *
+ * Format string of each call site is placed in section .binlog, which
+ * is not allocated: it stays in ELF file and never goes into flash. Its
+ * offset in the section is the ID of the call site, so the table is
+ * generated by linker at build time.
+ *
+ * Device sends only ID and arguments as a short line:
+ *     @IIII[AAAA[BBBB]]
+ * tool/binlog_decode.py reads format strings from ELF and restores text.
+ *
+ * Format supports %02X(8bit), %04X(16bit), %08b(8bit binary) and %%.
+ */
+#define BINLOG_ID(fmt) __extension__({                                  \
+    static const char __binlog_fmt[]                                    \
+        __attribute__((used, section(".binlog,\"\",@progbits ;"))) = fmt; \
+    (uint16_t)__binlog_fmt;                                             \
+})
+
+
+void binlog(uint16_t id, uint8_t argc, uint16_t a, uint16_t b);
+
+#endif
@@ -27,22 +27,40 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "matrix.h"
 #include "bootloader.h"
 #include "command.h"
+#include "idle_rate.h"
+#ifdef POWER_SAVE_ENABLE
+#   include "power.h"
+#endif
+#ifdef KEYMAP_OVERLAY_ENABLE
+#   include "keymap_overlay.h"
+#endif
+#ifdef PS2_LED_ENABLE
+#   include "ps2.h"
+#endif
 
 #ifdef HOST_PJRC
 #   include "usb_keyboard.h"
+#   include "usb_debug.h"
 #   ifdef EXTRAKEY_ENABLE
 #       include "usb_extra.h"
 #   endif
+#   ifdef MOUSE_ENABLE
+#       include "usb_mouse.h"
+#   endif
 #endif
 
 #ifdef HOST_VUSB
 #   include "usbdrv.h"
+#   include "vusb.h"
 #endif
 
 
 static uint8_t command_common(void);
 static void help(void);
 static void switch_layer(uint8_t layer);
+#if defined(HOST_PJRC) || defined(HOST_VUSB)
+static uint8_t next_polling_interval(uint8_t ms);
+#endif
 
 static bool last_print_enable;
 
@@ -144,16 +162,63 @@ static uint8_t command_common(void)
             print("UDINT: "); phex(UDINT); print("\n");
             print("usb_keyboard_leds:"); phex(usb_keyboard_leds); print("\n");
             print("usb_keyboard_protocol: "); phex(usb_keyboard_protocol); print("\n");
-            print("usb_keyboard_idle_config:"); phex(usb_keyboard_idle_config); print("\n");
-            print("usb_keyboard_idle_count:"); phex(usb_keyboard_idle_count); print("\n");
+            print("usb_keyboard_overflow: "); phex(usb_keyboard_overflow); print("\n");
+            print("usb_polling_interval: "); phex(usb_polling_interval); print("\n");
+            print("usb_keyboard_interval: "); phex(usb_keyboard_interval); print("\n");
+            print("usb_debug_overflow: "); phex16(usb_debug_overflow); print("\n");
+#   ifdef EXTRAKEY_ENABLE
+            print("usb_extra_overflow: "); phex(usb_extra_overflow); print("\n");
+#   endif
+#   ifdef MOUSE_ENABLE
+            print("usb_mouse_overflow: "); phex(usb_mouse_overflow); print("\n");
+#   endif
 #endif
+            print("idle_rate(kbd/mouse/sys/cons): ");
+            phex(idle_rate_get(IDLE_RATE_KEYBOARD)); print(" ");
+            phex(idle_rate_get(REPORT_ID_MOUSE)); print(" ");
+            phex(idle_rate_get(REPORT_ID_SYSTEM)); print(" ");
+            phex(idle_rate_get(REPORT_ID_CONSUMER)); print("\n");
 
+#ifdef POWER_SAVE_ENABLE
+            print("power_duty(%): "); phex(power_duty); print("\n");
+#endif
+#ifdef KEYMAP_OVERLAY_ENABLE
+            print("keymap_overlay_count: "); phex(keymap_overlay_count); print("\n");
+            print("keymap_overlay_writes: "); phex16(keymap_overlay_writes); print("\n");
+#endif
+#ifdef PS2_LED_ENABLE
+            print("ps2_led_coalesced: "); phex(ps2_led_coalesced); print("\n");
+#endif
 #ifdef HOST_VUSB
+            print("vusb_kbuf_max: "); phex(vusb_kbuf_max); print("\n");
+            print("vusb_kbuf_merged: "); phex(vusb_kbuf_merged); print("\n");
+            print("vusb_kbuf_overflow: "); phex(vusb_kbuf_overflow); print("\n");
+            print("vusb_polling_interval: "); phex(vusb_polling_interval); print("\n");
+            print("vusb_keyboard_interval: "); phex(vusb_keyboard_interval); print("\n");
 #   if USB_COUNT_SOF
             print("usbSofCount: "); phex(usbSofCount); print("\n");
 #   endif
 #endif
             break;
+#if defined(HOST_PJRC) || defined(HOST_VUSB)
+        case KB_R: // cycle report rate
+            host_clear_keyboard_report();
+            host_send_keyboard_report();
+#   ifdef HOST_PJRC
+            {
+                uint8_t ms = next_polling_interval(usb_polling_interval);
+                print("polling interval: "); phex(ms); print("ms, re-enumerate\n");
+                usb_set_polling_interval(ms);
+            }
+#   else
+            {
+                uint8_t ms = next_polling_interval(vusb_polling_interval);
+                print("polling interval: "); phex(ms); print("ms, re-enumerate\n");
+                vusb_set_polling_interval(ms);
+            }
+#   endif
+            break;
+#endif
 #ifdef NKRO_ENABLE
         case KB_N:
             // send empty report before change
@@ -184,6 +249,15 @@ static uint8_t command_common(void)
             _delay_ms(500);
 #endif
             break;
+#endif
+#ifdef KEYMAP_OVERLAY_ENABLE
+        case KB_E: // remap a key on current layer
+            keymap_overlay_edit(current_layer);
+            break;
+        case KB_W: // remove all remaps
+            keymap_overlay_clear();
+            print("remap: cleared\n");
+            break;
 #endif
         case KB_BSPC:
             matrix_init();
@@ -221,8 +295,15 @@ static void help(void)
     print("v: print version\n");
     print("t: print timer count\n");
     print("s: print status\n");
+#if defined(HOST_PJRC) || defined(HOST_VUSB)
+    print("r: cycle report rate(1/2/4/8/10ms)\n");
+#endif
 #ifdef NKRO_ENABLE
     print("n: toggle NKRO\n");
+#endif
+#ifdef KEYMAP_OVERLAY_ENABLE
+    print("e: remap a key on current layer\n");
+    print("w: remove all remaps\n");
 #endif
     print("Backspace: clear matrix\n");
     print("ESC: power down/wake up\n");
@@ -233,11 +314,23 @@ static void help(void)
     print("4: switch to Layer4 \n");
 }
 
+#if defined(HOST_PJRC) || defined(HOST_VUSB)
+/* report rate profiles: polling interval in ms */
+static uint8_t next_polling_interval(uint8_t ms)
+{
+    static const uint8_t intervals[] = { 1, 2, 4, 8, 10 };
+    for (uint8_t i = 0; i < sizeof(intervals); i++) {
+        if (intervals[i] > ms) return intervals[i];
+    }
+    return intervals[0];
+}
+#endif
+
 static void switch_layer(uint8_t layer)
 {
     print("current_layer: "); phex(current_layer); print("\n");
     print("default_layer: "); phex(default_layer); print("\n");
-    current_layer = layer;
     default_layer = layer;
+    layer_set(layer);
     print("switch to Layer: "); phex(layer); print("\n");
 }
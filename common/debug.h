@@ -27,6 +27,21 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define debug_bin(c)         if(debug_enable) pbin(c)
 #define debug_bin_reverse(c) if(debug_enable) pbin_reverse(c)
 
+/*
+ * Formatted debug: %02X, %04X, %08b and %% with up to two arguments.
+ * With BINLOG_ENABLE format is done on host, see binlog.h.
+ */
+#ifdef BINLOG_ENABLE
+#   include "binlog.h"
+#   define debugf(fmt)          if(debug_enable) binlog(BINLOG_ID(fmt), 0, 0, 0)
+#   define debugf1(fmt, a)      if(debug_enable) binlog(BINLOG_ID(fmt), 1, (a), 0)
+#   define debugf2(fmt, a, b)   if(debug_enable) binlog(BINLOG_ID(fmt), 2, (a), (b))
+#else
+#   define debugf(fmt)          if(debug_enable) print_fmt_P(PSTR(fmt), 0, 0)
+#   define debugf1(fmt, a)      if(debug_enable) print_fmt_P(PSTR(fmt), (a), 0)
+#   define debugf2(fmt, a, b)   if(debug_enable) print_fmt_P(PSTR(fmt), (a), (b))
+#endif
+
 
 bool debug_enable;
 bool debug_matrix;
@@ -0,0 +1,81 @@
+/*
+Copyright 2011 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix.h"
+#include "ghost.h"
+
+
+// matrix at last update
+static ghost_row_t rows[MATRIX_ROWS];
+// ambiguous keys
+static ghost_row_t ambiguous[MATRIX_ROWS];
+// key state to report
+static ghost_row_t state[MATRIX_ROWS];
+static bool exists = false;
+
+
+bool ghost_update(void)
+{
+    bool changed = false;
+
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+        ghost_row_t row = matrix_get_row(i);
+        if (row != rows[i]) {
+            rows[i] = row;
+            changed = true;
+        }
+    }
+    if (!changed) return false;
+
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) ambiguous[i] = 0;
+    // two rows sharing two or more columns make rectangles
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+        if (!(rows[i] & (rows[i] - 1))) continue;
+        for (uint8_t j = i + 1; j < MATRIX_ROWS; j++) {
+            ghost_row_t shared = rows[i] & rows[j];
+            if (shared & (shared - 1)) {
+                ambiguous[i] |= shared;
+                ambiguous[j] |= shared;
+            }
+        }
+    }
+
+    exists = false;
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+        if (ambiguous[i]) exists = true;
+        state[i] = (rows[i] & ~ambiguous[i]) | (state[i] & ambiguous[i]);
+    }
+    return true;
+}
+
+bool ghost_exists(void)
+{
+    return exists;
+}
+
+ghost_row_t ghost_get_row(uint8_t row)
+{
+    return ambiguous[row];
+}
+
+bool ghost_is_on(uint8_t row, uint8_t col)
+{
+    return (state[row] & ((ghost_row_t)1<<col));
+}
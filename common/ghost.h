@@ -0,0 +1,56 @@
+/*
+Copyright 2011 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef GHOST_H
+#define GHOST_H 1
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/*
+ * Ghost key detection for matrix without diodes(MATRIX_HAS_GHOST)
+ *
+ * When three keys at corners of a rectangle are pressed the fourth corner
+ * reads on as well, so on such matrix any key at a corner of a rectangle of
+ * keys on can't be told from a ghost. That is, key (r, c) is ambiguous when
+ * another row r' has c on and shares at least one more column on with row r.
+ * Ambiguous keys hold their last unambiguous state while other keys are
+ * reported as usual.
+ *
+ * Every pair of rows is compared, so an update takes O(rows^2) and is done
+ * only when matrix has changed.
+ */
+
+#if (MATRIX_COLS <= 8)
+typedef uint8_t ghost_row_t;
+#else
+typedef uint16_t ghost_row_t;
+#endif
+
+
+/* update ambiguous keys from matrix. returns true when matrix has changed. */
+bool ghost_update(void);
+/* whether any ambiguous key exists */
+bool ghost_exists(void);
+/* ambiguous keys on row */
+ghost_row_t ghost_get_row(uint8_t row);
+/* key state with ambiguous keys holding their last unambiguous state */
+bool ghost_is_on(uint8_t row, uint8_t col);
+
+#endif
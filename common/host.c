@@ -27,17 +27,24 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 bool keyboard_nkro = false;
 #endif
 
+uint8_t host_wheel_hires = 0;
+
 static host_driver_t *driver;
 static report_keyboard_t report0;
 static report_keyboard_t report1;
 report_keyboard_t *keyboard_report = &report0;
 report_keyboard_t *keyboard_report_prev = &report1;
 
+/* wheel movement not sent yet, 8.8 fixed point notches */
+static int16_t wheel_v = 0;
+static int16_t wheel_h = 0;
+
 
 static inline void add_key_byte(uint8_t code);
 static inline void del_key_byte(uint8_t code);
 static inline void add_key_bit(uint8_t code);
 static inline void del_key_bit(uint8_t code);
+static inline int8_t wheel_take(int16_t *wheel, bool hires);
 
 
 void host_set_driver(host_driver_t *d)
@@ -153,6 +160,27 @@ uint8_t host_get_first_key(void)
     return keyboard_report->keys[0];
 }
 
+/* mouse wheel operations */
+static inline int16_t wheel_clamp(int16_t a, int16_t b)
+{
+    int32_t n = (int32_t)a + b;
+    return (n > INT16_MAX ? INT16_MAX : (n < -INT16_MAX ? -INT16_MAX : n));
+}
+
+void host_wheel_add(int16_t v, int16_t h)
+{
+    wheel_v = wheel_clamp(wheel_v, v);
+    wheel_h = wheel_clamp(wheel_h, h);
+}
+
+bool host_wheel_pending(void)
+{
+    int16_t unit_v = (host_wheel_hires & 0x03 ? 256/HOST_WHEEL_MULTIPLIER : 256);
+    int16_t unit_h = (host_wheel_hires & 0x0C ? 256/HOST_WHEEL_MULTIPLIER : 256);
+    return (wheel_v >= unit_v || wheel_v <= -unit_v ||
+            wheel_h >= unit_h || wheel_h <= -unit_h);
+}
+
 
 void host_send_keyboard_report(void)
 {
@@ -162,6 +190,8 @@ void host_send_keyboard_report(void)
 
 void host_mouse_send(report_mouse_t *report)
 {
+    report->v = wheel_take(&wheel_v, host_wheel_hires & 0x03);
+    report->h = wheel_take(&wheel_h, host_wheel_hires & 0x0C);
     if (!driver) return;
     (*driver->send_mouse)(report);
 }
@@ -235,3 +265,14 @@ static inline void del_key_bit(uint8_t code)
         debug("del_key_bit: can't del: "); phex(code); debug("\n");
     }
 }
+
+/* takes whole units out of wheel movement, fraction is left for next report */
+static inline int8_t wheel_take(int16_t *wheel, bool hires)
+{
+    // divisions by constant are compiled to shifts
+    int16_t n = (hires ? *wheel / (256/HOST_WHEEL_MULTIPLIER) : *wheel / 256);
+    if (n > 127) n = 127;
+    if (n < -127) n = -127;
+    *wheel -= n * (hires ? 256/HOST_WHEEL_MULTIPLIER : 256);
+    return n;
+}
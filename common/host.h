@@ -19,14 +19,29 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define HOST_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "report.h"
 #include "host_driver.h"
 
 
+/* high resolution wheel units per notch, Physical Maximum of Resolution Multiplier
+ * in one-byte signed item of report descriptor */
+#ifndef HOST_WHEEL_MULTIPLIER
+#   define HOST_WHEEL_MULTIPLIER 8
+#endif
+#if (HOST_WHEEL_MULTIPLIER < 1 || HOST_WHEEL_MULTIPLIER > 64 || \
+     (HOST_WHEEL_MULTIPLIER & (HOST_WHEEL_MULTIPLIER - 1)))
+#   error "HOST_WHEEL_MULTIPLIER must be power of 2 and 64 or less."
+#endif
+
+
 #ifdef NKRO_ENABLE
 extern bool keyboard_nkro;
 #endif
 
+/* Resolution Multiplier feature set by host. bit0-1: vertical, bit2-3: horizontal */
+extern uint8_t host_wheel_hires;
+
 extern report_keyboard_t *keyboard_report;
 extern report_keyboard_t *keyboard_report_prev;
 
@@ -49,6 +64,11 @@ uint8_t host_has_anykey(void);
 uint8_t host_get_first_key(void);
 
 
+/* mouse wheel operations, amount is in 1/256 notch */
+void host_wheel_add(int16_t v, int16_t h);
+bool host_wheel_pending(void);
+
+
 void host_send_keyboard_report(void);
 void host_mouse_send(report_mouse_t *report);
 void host_system_send(uint16_t data);
@@ -0,0 +1,73 @@
+/*
+Copyright 2011 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include "idle_rate.h"
+
+
+/*
+ * Not protected from interrupt: pjrc calls these functions from USB
+ * interrupt or with interrupt disabled, V-USB only from main loop.
+ */
+static uint8_t idle_rate[IDLE_RATE_SLOTS] = { IDLE_RATE_KEYBOARD_DEFAULT };
+static uint16_t idle_elapsed[IDLE_RATE_SLOTS];
+
+
+void idle_rate_init(void)
+{
+    for (uint8_t i = 0; i < IDLE_RATE_SLOTS; i++) {
+        idle_rate[i] = 0;
+        idle_elapsed[i] = 0;
+    }
+    idle_rate[IDLE_RATE_KEYBOARD] = IDLE_RATE_KEYBOARD_DEFAULT;
+}
+
+void idle_rate_set(uint8_t report_id, uint8_t rate)
+{
+    if (report_id >= IDLE_RATE_SLOTS) return;
+    idle_rate[report_id] = rate;
+    idle_elapsed[report_id] = 0;
+}
+
+uint8_t idle_rate_get(uint8_t report_id)
+{
+    if (report_id >= IDLE_RATE_SLOTS) return 0;
+    return idle_rate[report_id];
+}
+
+void idle_rate_restart(uint8_t report_id)
+{
+    if (report_id >= IDLE_RATE_SLOTS) return;
+    idle_elapsed[report_id] = 0;
+}
+
+uint8_t idle_rate_tick(uint8_t ms)
+{
+    uint8_t due = 0;
+
+    for (uint8_t i = 0; i < IDLE_RATE_SLOTS; i++) {
+        // duration 0: send only on change
+        if (!idle_rate[i]) continue;
+
+        idle_elapsed[i] += ms;
+        if (idle_elapsed[i] >= (uint16_t)idle_rate[i] * 4) {
+            idle_elapsed[i] = 0;
+            due |= (1<<i);
+        }
+    }
+    return due;
+}
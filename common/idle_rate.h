@@ -0,0 +1,55 @@
+/*
+Copyright 2011 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IDLE_RATE_H
+#define IDLE_RATE_H 1
+
+#include <stdint.h>
+#include "report.h"
+
+
+/*
+ * HID idle rate(HID 1.11 7.2.4 Set_Idle Request)
+ *
+ * Duration is set by host per report ID in 4ms unit. When it elapses
+ * without new report the last one is repeated. Duration 0 means report
+ * is sent only when changed; Windows and Linux set 0 for keyboard, so
+ * then nothing is retransmitted.
+ *
+ * Time is advanced by protocol: pjrc calls idle_rate_tick() on every
+ * SOF(1ms) and V-USB calls it from main loop with elapsed milliseconds.
+ */
+
+/* keyboard report has no report ID */
+#define IDLE_RATE_KEYBOARD      0
+#define IDLE_RATE_SLOTS         (REPORT_ID_CONSUMER + 1)
+
+/* HID recommends 500ms for keyboard and 0(infinite) for others */
+#define IDLE_RATE_KEYBOARD_DEFAULT  125
+
+
+/* restore default durations. call on bus reset */
+void idle_rate_init(void);
+/* duration in 4ms unit for report ID. ID 0 on keyboard interface only */
+void idle_rate_set(uint8_t report_id, uint8_t rate);
+uint8_t idle_rate_get(uint8_t report_id);
+/* report was sent on change; restart its idle period */
+void idle_rate_restart(uint8_t report_id);
+/* advance time and return bits of report IDs to be repeated */
+uint8_t idle_rate_tick(uint8_t ms);
+
+#endif
@@ -14,10 +14,17 @@ GNU General Public License for more details.
 You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <string.h>
 #include "keyboard.h"
 #include "host.h"
 #include "layer.h"
 #include "matrix.h"
+#ifdef MATRIX_HAS_GHOST
+#include "ghost.h"
+#endif
+#ifdef KEYMAP_OVERLAY_ENABLE
+#include "keymap_overlay.h"
+#endif
 #include "led.h"
 #include "usb_keycodes.h"
 #include "timer.h"
@@ -35,27 +42,44 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 static uint8_t last_leds = 0;
 
+// key state in last scan to make key events
+#if (MATRIX_COLS <= 8)
+static uint8_t last_rows[MATRIX_ROWS];
+#else
+static uint16_t last_rows[MATRIX_ROWS];
+#endif
+
+#ifdef MATRIX_HAS_GHOST
+// ambiguous keys are left out, others are reported as usual
+#define KEY_IS_ON(row, col)     ghost_is_on(row, col)
+#else
+#define KEY_IS_ON(row, col)     matrix_is_on(row, col)
+#endif
+
 
 void keyboard_init(void)
 {
     timer_init();
     matrix_init();
+#ifdef KEYMAP_OVERLAY_ENABLE
+    keymap_overlay_init();
+#endif
 #ifdef PS2_MOUSE_ENABLE
     ps2_mouse_init();
 #endif
 }
 
 
-volatile unsigned char report_sent;
-
 void keyboard_proc(void)
 {
-    uint8_t fn_bits = 0;
 #ifdef EXTRAKEY_ENABLE
     uint16_t consumer_code = 0;
 #endif
 
     matrix_scan();
+#ifdef MATRIX_HAS_GHOST
+    bool ghost_changed = ghost_update();
+#endif
 
     if (matrix_is_modified()) {
         if (debug_matrix) matrix_print();
@@ -66,17 +90,37 @@ void keyboard_proc(void)
 #endif
     }
 
-    if (matrix_has_ghost()) {
-        // should send error?
-        debug("matrix has ghost!!\n");
-        return;
+#ifdef MATRIX_HAS_GHOST
+    if (ghost_changed && ghost_exists()) {
+        debugf("matrix has ghost!!\n");
+    }
+#endif
+
+    // key events
+    uint16_t time = timer_read();
+    layer_task(time);
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+        for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+            bool on = KEY_IS_ON(row, col);
+            if (on != (bool)(last_rows[row] & (1<<col))) {
+#ifdef KEYMAP_OVERLAY_ENABLE
+                if (!keymap_overlay_key_event(row, col, on))
+#endif
+                layer_key_event(row, col, on, time);
+                last_rows[row] ^= (1<<col);
+            }
+        }
     }
 
     host_swap_keyboard_report();
     host_clear_keyboard_report();
     for (int row = 0; row < matrix_rows(); row++) {
         for (int col = 0; col < matrix_cols(); col++) {
-            if (!matrix_is_on(row, col)) continue;
+            if (!KEY_IS_ON(row, col)) continue;
+            if (layer_key_is_deferred(row, col)) continue;
+#ifdef KEYMAP_OVERLAY_ENABLE
+            if (keymap_overlay_editing()) continue;
+#endif
 
             uint8_t code = layer_get_keycode(row, col);
             if (code == KB_NO) {
@@ -84,7 +128,7 @@ void keyboard_proc(void)
             } else if (IS_MOD(code)) {
                 host_add_mod_bit(MOD_BIT(code));
             } else if (IS_FN(code)) {
-                fn_bits |= FN_BIT(code);
+                // added by layer_report()
             }
 // TODO: use table or something
 #ifdef EXTRAKEY_ENABLE
@@ -161,20 +205,24 @@ void keyboard_proc(void)
             }
 #endif
             else {
-                debug("ignore keycode: "); debug_hex(code); debug("\n");
+                debugf1("ignore keycode: %02X\n", code);
             }
         }
     }
 
-    layer_switching(fn_bits);
+    layer_report();
+#ifdef KEYMAP_OVERLAY_ENABLE
+    keymap_overlay_task();
+#endif
 
     if (command_proc()) {
         return;
     }
 
-    // TODO: should send only when changed from last report
-    if (matrix_is_modified()) {
+    if (memcmp(keyboard_report, keyboard_report_prev, sizeof(report_keyboard_t))) {
         host_send_keyboard_report();
+    }
+    if (matrix_is_modified()) {
 #ifdef EXTRAKEY_ENABLE
         host_consumer_send(consumer_code);
 #endif
@@ -183,11 +231,6 @@ void keyboard_proc(void)
         DEBUG_LED_CONFIG;
         DEBUG_LED_OFF;
 #endif
-            while(!report_sent) print("+");
-    report_sent = 0;
-    print(".");
-    _delay_ms(100);
-
     }
 
 #ifdef MOUSEKEY_ENABLE
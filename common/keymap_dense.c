@@ -0,0 +1,29 @@
+/*
+Copyright 2011 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Dense keymap for tool/keymap_pack.py(KEYMAP_PACK_ENABLE)
+ *
+ * rules.mk compiles this with KEYMAP_PACK_SRC of the board and
+ * -DKEYMAP_PACK_DENSE. The object is only read by the tool and never linked.
+ */
+#include <stdint.h>
+#include KEYMAP_PACK_SRC
+
+
+/* matrix size for the tool */
+const uint8_t keymap_pack_dims[2] __attribute__ ((used)) = { MATRIX_ROWS, MATRIX_COLS };
@@ -0,0 +1,232 @@
+/*
+Copyright 2011 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/eeprom.h>
+#include "usb_keycodes.h"
+#include "keymap.h"
+#include "layer.h"
+#include "timer.h"
+#include "print.h"
+#include "debug.h"
+#include "keymap_overlay.h"
+
+
+#define MAGIC           0x4B
+#define IMAGE_SIZE      KEYMAP_OVERLAY_EEPROM_SIZE
+#define EEPROM_IMAGE    ((uint8_t *)KEYMAP_OVERLAY_EEPROM_ADDR)
+
+#if defined(E2END) && (KEYMAP_OVERLAY_EEPROM_ADDR + IMAGE_SIZE > E2END + 1)
+#   error "KEYMAP_OVERLAY_EEPROM_ADDR: overlay does not fit in EEPROM"
+#endif
+
+uint8_t keymap_overlay_count = 0;
+uint16_t keymap_overlay_writes = 0;
+
+// same layout as EEPROM
+static struct {
+    uint8_t magic;
+    uint8_t count;
+    struct {
+        uint8_t layer;
+        uint8_t row;
+        uint8_t col;
+        uint8_t code;
+    } key[KEYMAP_OVERLAY_SIZE];
+} image;
+
+// keys with override on any layer
+#if (MATRIX_COLS <= 8)
+static uint8_t marked[MATRIX_ROWS];
+#else
+static uint16_t marked[MATRIX_ROWS];
+#endif
+
+static bool dirty = false;
+static uint16_t dirty_time = 0;
+static uint8_t flush_pos = 0;
+
+// remap edit
+enum { EDIT_NONE, EDIT_TARGET, EDIT_SOURCE };
+static uint8_t edit = EDIT_NONE;
+static uint8_t edit_layer;
+static uint8_t edit_row;
+static uint8_t edit_col;
+static uint16_t edit_time;
+
+
+static void update_marked(void)
+{
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) marked[i] = 0;
+    for (uint8_t i = 0; i < image.count; i++) {
+        marked[image.key[i].row] |= (1<<image.key[i].col);
+    }
+    keymap_overlay_count = image.count;
+    layer_clear_cache();
+}
+
+static void changed(void)
+{
+    update_marked();
+    dirty = true;
+    dirty_time = timer_read();
+    flush_pos = 0;
+}
+
+// image in EEPROM can be left partly written by power loss
+static bool image_valid(void)
+{
+    if (image.magic != MAGIC || image.count > KEYMAP_OVERLAY_SIZE) return false;
+    for (uint8_t i = 0; i < image.count; i++) {
+        // layer is a bit of layer_state
+        if (image.key[i].layer >= 8 ||
+                image.key[i].row >= MATRIX_ROWS ||
+                image.key[i].col >= MATRIX_COLS ||
+                image.key[i].code > KB_MS_WH_RIGHT) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void keymap_overlay_init(void)
+{
+    eeprom_read_block(&image, EEPROM_IMAGE, IMAGE_SIZE);
+    if (!image_valid()) {
+        image.magic = MAGIC;
+        image.count = 0;
+    }
+    update_marked();
+}
+
+uint8_t keymap_overlay_get_keycode(uint8_t layer, uint8_t row, uint8_t col)
+{
+    if (marked[row] & (1<<col)) {
+        for (uint8_t i = 0; i < image.count; i++) {
+            if (image.key[i].layer == layer && image.key[i].row == row &&
+                    image.key[i].col == col) {
+                return image.key[i].code;
+            }
+        }
+    }
+    return keymap_get_keycode(layer, row, col);
+}
+
+bool keymap_overlay_set(uint8_t layer, uint8_t row, uint8_t col, uint8_t code)
+{
+    bool remove = (code == keymap_get_keycode(layer, row, col));
+    for (uint8_t i = 0; i < image.count; i++) {
+        if (image.key[i].layer == layer && image.key[i].row == row &&
+                image.key[i].col == col) {
+            if (remove) {
+                image.key[i] = image.key[--image.count];
+            } else {
+                image.key[i].code = code;
+            }
+            changed();
+            return true;
+        }
+    }
+    if (remove) return true;
+    if (image.count >= KEYMAP_OVERLAY_SIZE) return false;
+
+    image.key[image.count].layer = layer;
+    image.key[image.count].row = row;
+    image.key[image.count].col = col;
+    image.key[image.count].code = code;
+    image.count++;
+    changed();
+    return true;
+}
+
+void keymap_overlay_clear(void)
+{
+    image.count = 0;
+    changed();
+}
+
+void keymap_overlay_task(void)
+{
+    if (edit != EDIT_NONE && timer_elapsed(edit_time) > KEYMAP_OVERLAY_EDIT_TIMEOUT) {
+        print("remap: canceled\n");
+        edit = EDIT_NONE;
+    }
+
+    if (!dirty || timer_elapsed(dirty_time) < KEYMAP_OVERLAY_WRITE_DELAY) return;
+    if (!eeprom_is_ready()) return;
+
+    // write one byte at a time only when differ: keys in use, then magic
+    // and count last so that keys beyond old count are not loaded before
+    // they are written
+    uint8_t size = 2 + image.count * 4;
+    for (; flush_pos < size; flush_pos++) {
+        uint8_t pos = (flush_pos + 2) % size;
+        uint8_t data = ((uint8_t *)&image)[pos];
+        if (eeprom_read_byte(EEPROM_IMAGE + pos) != data) {
+            eeprom_write_byte(EEPROM_IMAGE + pos, data);
+            keymap_overlay_writes++;
+            flush_pos++;
+            return;
+        }
+    }
+    dirty = false;
+    debug("remap: saved\n");
+}
+
+void keymap_overlay_edit(uint8_t layer)
+{
+    print("remap: press key to change\n");
+    edit = EDIT_TARGET;
+    edit_layer = layer;
+    edit_time = timer_read();
+}
+
+bool keymap_overlay_editing(void)
+{
+    return (edit != EDIT_NONE);
+}
+
+bool keymap_overlay_key_event(uint8_t row, uint8_t col, bool pressed)
+{
+    if (edit == EDIT_NONE || !pressed) return false;
+
+    if (edit == EDIT_TARGET) {
+        edit_row = row;
+        edit_col = col;
+        edit = EDIT_SOURCE;
+        edit_time = timer_read();
+        print("remap: press key to copy(same key to restore)\n");
+    } else {
+        uint8_t code;
+        if (row == edit_row && col == edit_col) {
+            // restore keymap
+            code = keymap_get_keycode(edit_layer, row, col);
+        } else {
+            code = keymap_overlay_get_keycode(edit_layer, row, col);
+        }
+        if (keymap_overlay_set(edit_layer, edit_row, edit_col, code)) {
+            print("remap: "); phex(edit_row); print(":"); phex(edit_col);
+            print(" -> "); phex(code); print("\n");
+        } else {
+            print("remap: full\n");
+        }
+        edit = EDIT_NONE;
+    }
+    return true;
+}
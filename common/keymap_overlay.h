@@ -0,0 +1,84 @@
+/*
+Copyright 2011 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef KEYMAP_OVERLAY_H
+#define KEYMAP_OVERLAY_H 1
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/*
+ * Keymap overlay in EEPROM(KEYMAP_OVERLAY_ENABLE)
+ *
+ * Up to KEYMAP_OVERLAY_SIZE keys can be remapped without reflashing. The
+ * overrides are loaded from EEPROM into RAM at startup and looked up before
+ * keymap_get_keycode(). A bitmap of rows marks keys with override, so keys
+ * without it cost one bit test and others a search of the short list.
+ *
+ * Changes are written back KEYMAP_OVERLAY_WRITE_DELAY after last edit, one
+ * byte per scan and only bytes which differ from EEPROM. Keys are written
+ * before count, and an image with a key out of matrix is not loaded.
+ *
+ * EEPROM layout at KEYMAP_OVERLAY_EEPROM_ADDR:
+ *   magic(0x4B), count, {layer, row, col, keycode} * KEYMAP_OVERLAY_SIZE
+ * KEYMAP_OVERLAY_EEPROM_SIZE bytes are used, 0x20-0x61(66 bytes) by default.
+ * Address 0 is avoided as it is often used by others and can be corrupted
+ * on brown-out.
+ */
+
+#ifndef KEYMAP_OVERLAY_SIZE
+#   define KEYMAP_OVERLAY_SIZE          16
+#endif
+#ifndef KEYMAP_OVERLAY_EEPROM_ADDR
+#   define KEYMAP_OVERLAY_EEPROM_ADDR   0x20
+#endif
+#define KEYMAP_OVERLAY_EEPROM_SIZE      (2 + KEYMAP_OVERLAY_SIZE * 4)
+#ifndef KEYMAP_OVERLAY_WRITE_DELAY
+#   define KEYMAP_OVERLAY_WRITE_DELAY   3000
+#endif
+/* time(ms) to cancel remap edit */
+#ifndef KEYMAP_OVERLAY_EDIT_TIMEOUT
+#   define KEYMAP_OVERLAY_EDIT_TIMEOUT  10000
+#endif
+
+
+/* number of overrides */
+extern uint8_t keymap_overlay_count;
+/* bytes written to EEPROM */
+extern uint16_t keymap_overlay_writes;
+
+/* load overrides from EEPROM */
+void keymap_overlay_init(void);
+/* keycode with override */
+uint8_t keymap_overlay_get_keycode(uint8_t layer, uint8_t row, uint8_t col);
+/* remap key. keycode of keymap removes override. returns false when full. */
+bool keymap_overlay_set(uint8_t layer, uint8_t row, uint8_t col, uint8_t code);
+/* remove all overrides */
+void keymap_overlay_clear(void);
+/* write changes to EEPROM. call every scan */
+void keymap_overlay_task(void);
+
+/* start remap edit on layer: press key to remap and then key to copy */
+void keymap_overlay_edit(uint8_t layer);
+/* whether remap edit is going on. keys are not reported meanwhile. */
+bool keymap_overlay_editing(void);
+/* key event for remap edit. returns true when press is used. */
+bool keymap_overlay_key_event(uint8_t row, uint8_t col, bool pressed);
+
+#endif
@@ -0,0 +1,59 @@
+/*
+Copyright 2011 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/pgmspace.h>
+#include "usb_keycodes.h"
+#include "util.h"
+#include "keymap.h"
+#include "keymap_pack.h"
+
+
+static bool lookup(uint8_t layer, uint8_t row, uint8_t col, uint8_t *code)
+{
+#if (MATRIX_COLS <= 8)
+    uint8_t bits = pgm_read_byte(&keymap_pack_bits[layer][row]);
+    if (!(bits & ((uint16_t)1<<col))) return false;
+    uint8_t n = bitpop(bits & (((uint16_t)1<<col) - 1));
+#else
+    uint16_t bits = pgm_read_word(&keymap_pack_bits[layer][row]);
+    if (!(bits & ((uint16_t)1<<col))) return false;
+    bits &= ((uint16_t)1<<col) - 1;
+    uint8_t n = bitpop(bits) + bitpop(bits>>8);
+#endif
+    uint16_t i = (pgm_read_word(&keymap_pack_start[layer]) & ~KEYMAP_PACK_TRNS) +
+                 pgm_read_byte(&keymap_pack_offset[layer][row]) + n;
+    *code = pgm_read_byte(&keymap_pack_codes[i]);
+    return true;
+}
+
+uint8_t keymap_get_keycode(uint8_t layer, uint8_t row, uint8_t col)
+{
+    uint8_t code;
+    if (lookup(layer, row, col, &code))
+        return code;
+    if (!layer)
+        return KB_NO;
+    // not stored: transparent or same as base layer
+    if (pgm_read_word(&keymap_pack_start[layer]) & KEYMAP_PACK_TRNS)
+        return KB_TRNS;
+    if (lookup(0, row, col, &code))
+        return code;
+    return KB_NO;
+}
@@ -0,0 +1,56 @@
+/*
+Copyright 2011 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef KEYMAP_PACK_H
+#define KEYMAP_PACK_H 1
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+
+/*
+ * Packed keymap(KEYMAP_PACK_ENABLE)
+ *
+ * keymaps[][MATRIX_ROWS][MATRIX_COLS] of keymap.c is converted at build time
+ * by tool/keymap_pack.py. Base layer(0) stores only keys other than KB_NO
+ * and other layers store only keys different from base layer, or keys other
+ * than KB_TRNS if the layer has any KB_TRNS. For each row a bitmap tells
+ * which columns are stored and their keycodes follow in order, so a lookup
+ * reads at most two rows with no search.
+ *
+ *   keymap_pack_start[layer]:      index of first keycode of layer,
+ *                                  KEYMAP_PACK_TRNS: keys not stored are KB_TRNS
+ *   keymap_pack_bits[layer][row]:  columns stored
+ *   keymap_pack_offset[layer][row]: keycodes of layer before the row
+ *   keymap_pack_codes[]:           keycodes
+ */
+
+#define KEYMAP_PACK_TRNS    0x8000
+
+#if (MATRIX_COLS <= 8)
+typedef uint8_t keymap_pack_row_t;
+#else
+typedef uint16_t keymap_pack_row_t;
+#endif
+
+extern const uint16_t PROGMEM keymap_pack_start[];
+extern const keymap_pack_row_t PROGMEM keymap_pack_bits[][MATRIX_ROWS];
+extern const uint8_t PROGMEM keymap_pack_offset[][MATRIX_ROWS];
+extern const uint8_t PROGMEM keymap_pack_codes[];
+
+#endif
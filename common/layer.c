@@ -15,12 +15,21 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <string.h>
+#include <avr/io.h>
 #include "keymap.h"
 #include "host.h"
 #include "debug.h"
 #include "timer.h"
 #include "usb_keycodes.h"
+#include "util.h"
 #include "layer.h"
+#ifdef KEYMAP_OVERLAY_ENABLE
+#   include "keymap_overlay.h"
+#   define KEYMAP_GET(layer, row, col)  keymap_overlay_get_keycode(layer, row, col)
+#else
+#   define KEYMAP_GET(layer, row, col)  keymap_get_keycode(layer, row, col)
+#endif
 
 
 /*
@@ -67,6 +76,21 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *     Layer sw         ___________________________
  *     Fn key press     ___|~|____|~~~~~~~~~~~~~~~~
  *     Fn key send      _____|~|__|~~~~~~~~~~~~~~~~
+ *
+ * Fn keys are processed per key event with its time. An Fn key pressed
+ * waits for its switch until LAYER_SWITCH_DELAY, during which press of
+ * other key makes it a normal key(case 4). An Fn key without keycode has
+ * nothing to send and switches at once with no LAYER_SWITCH_DELAY, even
+ * while other key is pressed(no case 4 and 5). Keys pressed in that scan are
+ * held back one report so that Fn keycode goes first, up to LAYER_DEFER_SIZE
+ * keys. Keycodes of Fn keys are added to keyboard report by layer_report()
+ * and sent through the normal path of keyboard_proc().
+ *
+ * Layer stacking:
+ * default_layer and layers of Fn keys being held are active at a time and
+ * layer_state has a bit on for each of them. A key resolves to keycode of
+ * the highest active layer which is not KB_TRNS(transparent) on the key,
+ * so a Fn layer needs to define only keys it changes.
  */
 
 // LAYER_SWITCH_DELAY: prevent from moving to new layer
@@ -80,128 +104,246 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #endif
 
 
+// LAYER_CACHE_ENABLE: keep keycodes resolved on active layers in RAM.
+// MATRIX_ROWS*MATRIX_COLS bytes, read from PROGMEM on less than 2KB RAM.
+#if defined(LAYER_CACHE_ENABLE) && (RAMEND < 0x8FF)
+#   undef LAYER_CACHE_ENABLE
+#endif
+
+
 uint8_t default_layer = 0;
 uint8_t current_layer = 0;
+uint8_t layer_state = 1<<0;
+
+
+// Fn key states
+enum {
+    FN_IDLE,
+    FN_TAPPED,      // released after sending keycode, time: released
+    FN_PENDING,     // waiting for LAYER_SWITCH_DELAY, time: pressed
+    FN_HOLD,        // layer switched, time: pressed
+    FN_HOLD_USED,   // layer switched and used
+    FN_SENT,        // acting as normal key
+};
+static struct {
+    uint8_t state;
+    uint8_t row;
+    uint8_t col;
+    uint16_t time;
+} fn[8];
+
+// Fn keys to send its keycode only in next report
+static uint8_t oneshot = 0;
+
+// keys held back from next report
+#ifndef LAYER_DEFER_SIZE
+#   define LAYER_DEFER_SIZE 4
+#endif
+static struct {
+    uint8_t row;
+    uint8_t col;
+} deferred[LAYER_DEFER_SIZE];
+static uint8_t deferred_count = 0;
+// Fn became key in this scan, keys pressed with it are held back
+static bool deferring = false;
+
+
+static void fn_press(uint8_t i, uint16_t time);
+static void fn_release(uint8_t i, uint16_t time);
+static uint8_t new_layer_state(void);
+static void set_layer_state(uint8_t state);
+
+// search active layers from top and stop at first non-transparent keycode
+static uint8_t resolve_keycode(uint8_t state, uint8_t row, uint8_t col)
+{
+    for (uint8_t layer = biton(state); state; layer--) {
+        if (state & (1<<layer)) {
+            uint8_t code = KEYMAP_GET(layer, row, col);
+            if (code != KB_TRNS) return code;
+            state &= ~(1<<layer);
+        }
+    }
+    return KB_NO;
+}
 
-static bool layer_used = false;
-static uint8_t new_layer(uint8_t fn_bits);
+#ifdef LAYER_CACHE_ENABLE
+// keycode is resolved at its first lookup after layer change, not all keys
+// at once which takes up to 8 keymap reads per key in one scan.
+// KB_TRNS: not resolved yet(resolve_keycode() never returns it)
+static uint8_t cache[MATRIX_ROWS][MATRIX_COLS];
+static uint8_t cache_state = 0;     // 0: not loaded
 
+static void cache_load(uint8_t state)
+{
+    memset(cache, KB_TRNS, sizeof(cache));
+    cache_state = state;
+}
+#endif
+
+
+void layer_clear_cache(void)
+{
+#ifdef LAYER_CACHE_ENABLE
+    cache_state = 0;
+#endif
+}
+
+void layer_set(uint8_t layer)
+{
+    set_layer_state(1<<layer);
+}
 
 uint8_t layer_get_keycode(uint8_t row, uint8_t col)
 {
-    uint8_t code = keymap_get_keycode(current_layer, row, col);
-    // normal key or mouse key
-    if ((IS_KEY(code) || IS_MOUSEKEY(code))) {
-        layer_used = true;
+#ifdef LAYER_CACHE_ENABLE
+    // load when active layers are changed
+    if (cache_state != layer_state) cache_load(layer_state);
+    if (cache[row][col] == KB_TRNS)
+        cache[row][col] = resolve_keycode(layer_state, row, col);
+    return cache[row][col];
+#else
+    return resolve_keycode(layer_state, row, col);
+#endif
+}
+
+void layer_task(uint16_t time)
+{
+    // one shot keycodes and deferred keys were in last report
+    oneshot = 0;
+    deferred_count = 0;
+    deferring = false;
+
+    for (uint8_t i = 0; i < 8; i++) {
+        if (fn[i].state == FN_PENDING &&
+                TIMER_DIFF_MS(time, fn[i].time) > LAYER_SWITCH_DELAY) {
+            debugf1("Fn case: 1,2,3(LAYER_SWITCH_DELAY passed): %02X\n", i);
+            fn[i].state = FN_HOLD;
+            set_layer_state(layer_state | 1<<keymap_fn_layer(1<<i));
+        }
     }
-    return code;
 }
 
-// bit substract b from a
-#define BIT_SUBST(a, b) (a&(a^b))
-void layer_switching(uint8_t fn_bits)
+void layer_key_event(uint8_t row, uint8_t col, bool pressed, uint16_t time)
 {
-    // layer switching
-    static uint8_t last_fn = 0;
-    static uint8_t last_mods = 0;
-    static uint16_t last_timer = 0; 
-    static uint8_t sent_fn = 0;
-
-    if (fn_bits == last_fn) { // Fn state is not changed
-        if (fn_bits == 0) {
-            // do nothing
-        } else {
-            if (!keymap_fn_keycode(BIT_SUBST(fn_bits, sent_fn)) ||
-                    timer_elapsed(last_timer) > LAYER_SWITCH_DELAY) {
-                uint8_t _layer_to_switch = new_layer(BIT_SUBST(fn_bits, sent_fn));
-                if (current_layer != _layer_to_switch) { // not switch layer yet
-                    debug("Fn case: 1,2,3(LAYER_SWITCH_DELAY passed)\n");
-                    debug("Switch Layer: "); debug_hex(current_layer);
-                    current_layer = _layer_to_switch;
-                    layer_used = false;
-                    debug(" -> "); debug_hex(current_layer); debug("\n");
-                }
-            } else {
-                if (host_has_anykey()) { // other keys is pressed
-                    uint8_t _fn_to_send = BIT_SUBST(fn_bits, sent_fn);
-                    if (_fn_to_send) {
-                        debug("Fn case: 4(press other key during SWITCH_DELAY.)\n");
-                        // send only Fn key first
-                        uint8_t tmp_mods = keyboard_report->mods;
-                        host_add_code(keymap_fn_keycode(_fn_to_send));
-                        host_set_mods(last_mods);
-                        host_send_keyboard_report();
-                        host_set_mods(tmp_mods);
-                        host_del_code(keymap_fn_keycode(_fn_to_send));
-                        sent_fn |= _fn_to_send;
-                    }
-                }
+    if (!pressed) {
+        for (uint8_t i = 0; i < 8; i++) {
+            if (fn[i].state >= FN_PENDING && fn[i].row == row && fn[i].col == col) {
+                fn_release(i, time);
+                return;
             }
-            // add Fn keys to send
-            //host_add_code(keymap_fn_keycode(fn_bits&sent_fn));  // TODO: do all Fn keys
         }
-    } else { // Fn state is changed(edge)
-        uint8_t fn_changed = 0;
-
-        debug("fn_bits: "); debug_bin(fn_bits); debug("\n");
-        debug("sent_fn: "); debug_bin(sent_fn); debug("\n");
-        debug("last_fn: "); debug_bin(last_fn); debug("\n");
-        debug("last_mods: "); debug_hex(last_mods); debug("\n");
-        debug("last_timer: "); debug_hex16(last_timer); debug("\n");
-        debug("timer_count: "); debug_hex16(timer_count); debug("\n");
-
-        // pressed Fn
-        if ((fn_changed = BIT_SUBST(fn_bits, last_fn))) {
-            debug("fn_changed: "); debug_bin(fn_changed); debug("\n");
-            if (host_has_anykey()) {
-                debug("Fn case: 5(pressed Fn with other key)\n");
-                sent_fn |= fn_changed;
-            } else if (fn_changed & sent_fn) { // pressed same Fn in a row
-                if (timer_elapsed(last_timer) > LAYER_SEND_FN_TERM) {
-                    debug("Fn case: 6(not repeat)\n");
-                    // time passed: not repeate
-                    sent_fn &= ~fn_changed;
-                } else {
-                    debug("Fn case: 6(repeat)\n");
-                }
-            }
+        return;
+    }
+
+    uint8_t code = layer_get_keycode(row, col);
+    if (IS_FN(code)) {
+        uint8_t i = code - KB_FN0;
+        fn[i].row = row;
+        fn[i].col = col;
+        fn_press(i, time);
+        return;
+    }
+
+    if (!IS_KEY(code) && !IS_MOUSEKEY(code)) return;
+    for (uint8_t i = 0; i < 8; i++) {
+        if (fn[i].state == FN_HOLD) {
+            fn[i].state = FN_HOLD_USED;
+        } else if (fn[i].state == FN_PENDING && IS_KEY(code)) {
+            debugf1("Fn case: 4(press other key during SWITCH_DELAY): %02X\n", i);
+            fn[i].state = FN_SENT;
+            deferring = true;
         }
-        // released Fn
-        if ((fn_changed = BIT_SUBST(last_fn, fn_bits))) {
-            debug("fn_changed: "); debug_bin(fn_changed); debug("\n");
-            if (timer_elapsed(last_timer) < LAYER_SEND_FN_TERM) {
-                if (!layer_used && BIT_SUBST(fn_changed, sent_fn)) {
-                    debug("Fn case: 2(send Fn one shot: released Fn during LAYER_SEND_FN_TERM)\n");
-                    // send only Fn key first
-                    uint8_t tmp_mods = keyboard_report->mods;
-                    host_add_code(keymap_fn_keycode(fn_changed));
-                    host_set_mods(last_mods);
-                    host_send_keyboard_report();
-                    host_set_mods(tmp_mods);
-                    host_del_code(keymap_fn_keycode(fn_changed));
-                    sent_fn |= fn_changed;
-                }
-            }
-            debug("Switch Layer(released Fn): "); debug_hex(current_layer);
-            current_layer = new_layer(BIT_SUBST(fn_bits, sent_fn));
-            debug(" -> "); debug_hex(current_layer); debug("\n");
+    }
+
+    // send Fn keycode first
+    if (deferring && IS_KEY(code)) {
+        if (deferred_count < LAYER_DEFER_SIZE) {
+            deferred[deferred_count].row = row;
+            deferred[deferred_count].col = col;
+            deferred_count++;
+        } else {
+            debugf2("Fn: defer full, sent with Fn: %02X %02X\n", row, col);
         }
+    }
+}
 
-        layer_used = false;
-        last_fn = fn_bits;
-        last_mods = keyboard_report->mods;
-        last_timer = timer_read();
+bool layer_key_is_deferred(uint8_t row, uint8_t col)
+{
+    for (uint8_t i = 0; i < deferred_count; i++) {
+        if (deferred[i].row == row && deferred[i].col == col)
+            return true;
     }
-    // send Fn keys
+    return false;
+}
+
+void layer_report(void)
+{
     for (uint8_t i = 0; i < 8; i++) {
-        if ((sent_fn & fn_bits) & (1<<i)) {
+        if (fn[i].state == FN_SENT || (oneshot & (1<<i))) {
             host_add_code(keymap_fn_keycode(1<<i));
         }
     }
 }
 
-inline
-static uint8_t new_layer(uint8_t fn_bits)
+
+static void fn_press(uint8_t i, uint16_t time)
+{
+    uint8_t bit = 1<<i;
+    if (!keymap_fn_keycode(bit)) {
+        // no keycode to send: switch at once
+        fn[i].state = FN_HOLD;
+        set_layer_state(layer_state | 1<<keymap_fn_layer(bit));
+    } else if (host_has_anykey()) {
+        debugf1("Fn case: 5(pressed Fn with other key): %02X\n", i);
+        fn[i].state = FN_SENT;
+    } else if (fn[i].state == FN_TAPPED &&
+            TIMER_DIFF_MS(time, fn[i].time) <= LAYER_SEND_FN_TERM) {
+        debugf1("Fn case: 6(repeat): %02X\n", i);
+        fn[i].state = FN_SENT;
+    } else {
+        fn[i].state = FN_PENDING;
+    }
+    fn[i].time = time;
+}
+
+static void fn_release(uint8_t i, uint16_t time)
+{
+    uint8_t state = fn[i].state;
+    bool in_term = (TIMER_DIFF_MS(time, fn[i].time) < LAYER_SEND_FN_TERM);
+
+    fn[i].state = FN_IDLE;
+    if (state == FN_HOLD || state == FN_HOLD_USED) {
+        set_layer_state(new_layer_state());
+    }
+
+    if (state == FN_SENT) {
+        fn[i].state = FN_TAPPED;
+    } else if ((state == FN_PENDING || state == FN_HOLD) &&
+            in_term && keymap_fn_keycode(1<<i)) {
+        debugf1("Fn case: 2(send Fn one shot: released Fn during LAYER_SEND_FN_TERM): %02X\n", i);
+        oneshot |= 1<<i;
+        fn[i].state = FN_TAPPED;
+    }
+    fn[i].time = time;
+}
+
+// default layer and layers of Fn keys held down
+static uint8_t new_layer_state(void)
+{
+    uint8_t state = 1<<default_layer;
+    for (uint8_t i = 0; i < 8; i++) {
+        if (fn[i].state == FN_HOLD || fn[i].state == FN_HOLD_USED) {
+            state |= 1<<keymap_fn_layer(1<<i);
+        }
+    }
+    return state;
+}
+
+static void set_layer_state(uint8_t state)
 {
-    return (fn_bits ? keymap_fn_layer(fn_bits) : default_layer);
+    if (layer_state != state) {
+        debugf2("Switch Layer: %08b -> %08b\n", layer_state, state);
+    }
+    layer_state = state;
+    current_layer = biton(state);
 }
@@ -19,14 +19,33 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define LAYER_H 1
 
 #include <stdint.h>
+#include <stdbool.h>
 
 extern uint8_t default_layer;
+/* top of active layers */
 extern uint8_t current_layer;
+/* active layers: bit n is on when layer n is active */
+extern uint8_t layer_state;
+
+/* activate only the layer */
+void layer_set(uint8_t layer);
+
+/* discard keycodes cached in RAM(LAYER_CACHE_ENABLE) after keymap change */
+void layer_clear_cache(void);
 
 /* return keycode for switch */
 uint8_t layer_get_keycode(uint8_t row, uint8_t col);
 
-/* process layer switching */
-void layer_switching(uint8_t fn_bits);
+/* process Fn key timeouts. call once per scan before key events */
+void layer_task(uint16_t time);
+
+/* key switched on or off at time(timer_read()) */
+void layer_key_event(uint8_t row, uint8_t col, bool pressed, uint16_t time);
+
+/* whether key should be left out of report until next scan */
+bool layer_key_is_deferred(uint8_t row, uint8_t col);
+
+/* add keycodes of Fn keys to keyboard report */
+void layer_report(void);
 
 #endif
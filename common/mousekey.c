@@ -16,7 +16,6 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <stdint.h>
-#include <util/delay.h>
 #include "usb_keycodes.h"
 #include "host.h"
 #include "timer.h"
@@ -25,97 +24,175 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "mousekey.h"
 
 
-static report_mouse_t report;
-static report_mouse_t report_prev;
+/* direction keys */
+#define DIR_UP      (1<<0)
+#define DIR_DOWN    (1<<1)
+#define DIR_LEFT    (1<<2)
+#define DIR_RIGHT   (1<<3)
+
+/* speeds are in units per report, 16.16 fixed point so that small
+ * acceleration steps are not lost. Reports are in 8.8 fixed point. */
+typedef struct {
+    uint16_t delay;
+    uint16_t interval;
+    uint32_t first;     // amount of first report on press
+    uint32_t delta;
+    uint32_t max;
+    uint32_t accel;     // added to speed every repeat
+} motion_param_t;
+
+typedef struct {
+    uint8_t  dirs;      // direction keys held on last scan
+    uint32_t speed;
+    uint16_t wait;      // ms until next report
+    uint16_t last;      // time of last report
+} motion_t;
+
+#define SPEED(units)    ((uint32_t)(units)<<16)
+#define ACCEL(delta, max, interval, time_to_max) \
+    ((time_to_max) > (interval) ? \
+     (uint32_t)(((uint64_t)(max) - (delta)) * (interval) / (time_to_max)) : \
+     (uint32_t)((max) - (delta)))
+
+/* wheel speed per MOUSEKEY_INTERVAL in high resolution mode, in notches */
+#define WHEEL_HIRES_SPEED(units) \
+    ((uint32_t)((uint64_t)SPEED(units) * MOUSEKEY_INTERVAL / MOUSEKEY_WHEEL_INTERVAL))
+
+static const motion_param_t move_param = {
+    MOUSEKEY_DELAY, MOUSEKEY_INTERVAL,
+    SPEED(MOUSEKEY_MOVE_DELTA),
+    SPEED(MOUSEKEY_MOVE_DELTA), SPEED(MOUSEKEY_MAX_SPEED),
+    ACCEL(SPEED(MOUSEKEY_MOVE_DELTA), SPEED(MOUSEKEY_MAX_SPEED),
+          MOUSEKEY_INTERVAL, MOUSEKEY_TIME_TO_MAX)
+};
+static const motion_param_t wheel_param = {
+    MOUSEKEY_WHEEL_DELAY, MOUSEKEY_WHEEL_INTERVAL,
+    SPEED(MOUSEKEY_WHEEL_DELTA),
+    SPEED(MOUSEKEY_WHEEL_DELTA), SPEED(MOUSEKEY_WHEEL_MAX_SPEED),
+    ACCEL(SPEED(MOUSEKEY_WHEEL_DELTA), SPEED(MOUSEKEY_WHEEL_MAX_SPEED),
+          MOUSEKEY_WHEEL_INTERVAL, MOUSEKEY_WHEEL_TIME_TO_MAX)
+};
+/* same wheel speed in small steps every MOUSEKEY_INTERVAL when host accepts
+ * fractional notches(Resolution Multiplier), first report is still a notch */
+static const motion_param_t wheel_hires_param = {
+    MOUSEKEY_WHEEL_DELAY, MOUSEKEY_INTERVAL,
+    SPEED(MOUSEKEY_WHEEL_DELTA),
+    WHEEL_HIRES_SPEED(MOUSEKEY_WHEEL_DELTA), WHEEL_HIRES_SPEED(MOUSEKEY_WHEEL_MAX_SPEED),
+    ACCEL(WHEEL_HIRES_SPEED(MOUSEKEY_WHEEL_DELTA), WHEEL_HIRES_SPEED(MOUSEKEY_WHEEL_MAX_SPEED),
+          MOUSEKEY_INTERVAL, MOUSEKEY_WHEEL_TIME_TO_MAX)
+};
+
+static motion_t move;
+static motion_t wheel;
+static uint8_t move_frac;   // fraction of unit carried over to next report
+
+/* keys held on this scan, collected by mousekey_decode() */
+static uint8_t move_dirs;
+static uint8_t wheel_dirs;
+static uint8_t buttons;
 
-static uint8_t mousekey_repeat =  0;
+static report_mouse_t report;
 
 static void mousekey_debug(void);
 
 
 /*
- * TODO: fix acceleration algorithm
- * see wikipedia http://en.wikipedia.org/wiki/Mouse_keys
+ * Returns amount to move in this report, or 0 when it is not time to report.
+ * Diagonal motion is scaled by 181/256(~1/sqrt(2)) to keep the same speed.
  */
-#ifndef MOUSEKEY_DELAY_TIME
-#   define MOUSEKEY_DELAY_TIME 255
-#endif
+static uint16_t motion_step(motion_t *m, const motion_param_t *p, uint8_t dirs)
+{
+    uint16_t amount;
 
-// acceleration parameters
-uint8_t mousekey_move_unit = 2;
-uint8_t mousekey_resolution = 5;
+    if (!dirs) {
+        m->dirs = 0;
+        return 0;
+    }
+
+    if (!m->dirs) {
+        // first report on press, then wait for delay
+        m->speed = p->delta;
+        m->wait = p->delay;
+        amount = p->first>>8;
+    } else {
+        if (timer_elapsed(m->last) < m->wait) {
+            m->dirs = dirs;
+            return 0;
+        }
+        m->wait = p->interval;
+        m->speed = (p->max - m->speed > p->accel ? m->speed + p->accel : p->max);
+        amount = m->speed>>8;
+    }
+    m->dirs = dirs;
+    m->last = timer_read();
 
+    if ((dirs & (DIR_UP|DIR_DOWN)) && (dirs & (DIR_LEFT|DIR_RIGHT))) {
+        amount = ((uint32_t)amount * 181)>>8;
+    }
+    return amount;
+}
 
-static inline uint8_t move_unit(void)
+static inline int16_t axis(uint8_t dirs, uint8_t neg, uint8_t pos, uint16_t amount)
 {
-    uint16_t unit = 5 + mousekey_repeat*2;
-    return (unit > 63 ? 63 : unit);
+    if ((dirs & neg) && !(dirs & pos)) return -amount;
+    if ((dirs & pos) && !(dirs & neg)) return amount;
+    return 0;
 }
 
 void mousekey_decode(uint8_t code)
 {
-    if      (code == KB_MS_UP)      report.y = -move_unit();
-    else if (code == KB_MS_DOWN)    report.y = move_unit();
-    else if (code == KB_MS_LEFT)    report.x = -move_unit();
-    else if (code == KB_MS_RIGHT)   report.x = move_unit();
-    else if (code == KB_MS_BTN1)    report.buttons |= MOUSE_BTN1;
-    else if (code == KB_MS_BTN2)    report.buttons |= MOUSE_BTN2;
-    else if (code == KB_MS_BTN3)    report.buttons |= MOUSE_BTN3;
-    else if (code == KB_MS_BTN4)    report.buttons |= MOUSE_BTN4;
-    else if (code == KB_MS_BTN5)    report.buttons |= MOUSE_BTN5;
-    else if (code == KB_MS_WH_UP)   report.v += move_unit()/4;
-    else if (code == KB_MS_WH_DOWN) report.v -= move_unit()/4;
-    else if (code == KB_MS_WH_LEFT) report.h -= move_unit()/4;
-    else if (code == KB_MS_WH_RIGHT)report.h += move_unit()/4;
+    if      (code == KB_MS_UP)      move_dirs |= DIR_UP;
+    else if (code == KB_MS_DOWN)    move_dirs |= DIR_DOWN;
+    else if (code == KB_MS_LEFT)    move_dirs |= DIR_LEFT;
+    else if (code == KB_MS_RIGHT)   move_dirs |= DIR_RIGHT;
+    else if (code == KB_MS_BTN1)    buttons |= MOUSE_BTN1;
+    else if (code == KB_MS_BTN2)    buttons |= MOUSE_BTN2;
+    else if (code == KB_MS_BTN3)    buttons |= MOUSE_BTN3;
+    else if (code == KB_MS_BTN4)    buttons |= MOUSE_BTN4;
+    else if (code == KB_MS_BTN5)    buttons |= MOUSE_BTN5;
+    else if (code == KB_MS_WH_UP)   wheel_dirs |= DIR_UP;
+    else if (code == KB_MS_WH_DOWN) wheel_dirs |= DIR_DOWN;
+    else if (code == KB_MS_WH_LEFT) wheel_dirs |= DIR_LEFT;
+    else if (code == KB_MS_WH_RIGHT)wheel_dirs |= DIR_RIGHT;
 }
 
 bool mousekey_changed(void)
 {
-    return (report.buttons != report_prev.buttons ||
-            report.x || report.y || report.v || report.h);
+    return (buttons != report.buttons || move_dirs || wheel_dirs);
 }
 
 void mousekey_send(void)
 {
-    static uint16_t last_timer = 0;
-
-    if (!mousekey_changed()) {
-        mousekey_repeat = 0;
-        mousekey_clear_report();
-        return;
+    bool send = (buttons != report.buttons);
+    report.buttons = buttons;
+    report.x = report.y = 0;
+
+    uint16_t amount = motion_step(&move, &move_param, move_dirs);
+    if (amount) {
+        amount += move_frac;
+        move_frac = amount & 0xFF;
+        report.x = axis(move_dirs, DIR_LEFT, DIR_RIGHT, amount>>8);
+        report.y = axis(move_dirs, DIR_UP, DIR_DOWN, amount>>8);
     }
 
-    // send immediately when buttun state is changed
-    if (report.buttons == report_prev.buttons) {
-        if (timer_elapsed(last_timer) < 100) {
-            mousekey_clear_report();
-            return;
-        }
+    amount = motion_step(&wheel, (host_wheel_hires ? &wheel_hires_param : &wheel_param), wheel_dirs);
+    if (amount) {
+        host_wheel_add(axis(wheel_dirs, DIR_DOWN, DIR_UP, amount),
+                       axis(wheel_dirs, DIR_LEFT, DIR_RIGHT, amount));
     }
 
-    if (mousekey_repeat != 0xFF) {
-        mousekey_repeat++;
+    if (send || report.x || report.y || host_wheel_pending()) {
+        host_mouse_send(&report);
+        mousekey_debug();
     }
-
-    if (report.x && report.y) {
-        report.x *= 0.7;
-        report.y *= 0.7;
-    }
-
-    mousekey_debug();
-    host_mouse_send(&report);
-    report_prev = report;
-    last_timer = timer_read();
     mousekey_clear_report();
 }
 
 void mousekey_clear_report(void)
 {
-    report.buttons = 0;
-    report.x = 0;
-    report.y = 0;
-    report.v = 0;
-    report.h = 0;
+    move_dirs = 0;
+    wheel_dirs = 0;
+    buttons = 0;
 }
 
 static void mousekey_debug(void)
@@ -126,7 +203,8 @@ static void mousekey_debug(void)
     phex(report.x); print(" ");
     phex(report.y); print(" ");
     phex(report.v); print(" ");
-    phex(report.h);
-    phex(mousekey_repeat);
+    phex(report.h); print(" speed: ");
+    phex16(move.speed>>8); print(" ");
+    phex16(wheel.speed>>8);
     print("\n");
 }
@@ -21,6 +21,54 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdbool.h>
 #include "host.h"
 
+
+/*
+ * Mouse key parameters(overridable in config.h), in the manner of X11 MouseKeys.
+ * A motion is sent when keys are pressed, then repeated every INTERVAL ms
+ * after DELAY ms. It starts at MOVE_DELTA units per report and speeds up
+ * linearly to MAX_SPEED units per report in TIME_TO_MAX ms of repeating.
+ * Fractions are carried over to next reports, so low speeds are smooth too.
+ * Cursor and wheel have their own timings. When host enables high resolution
+ * wheel the wheel moves in small steps every MOUSEKEY_INTERVAL at same speed.
+ */
+#ifndef MOUSEKEY_DELAY_TIME
+#   define MOUSEKEY_DELAY_TIME 255
+#endif
+#ifndef MOUSEKEY_DELAY
+#   define MOUSEKEY_DELAY MOUSEKEY_DELAY_TIME
+#endif
+#ifndef MOUSEKEY_INTERVAL
+#   define MOUSEKEY_INTERVAL 8
+#endif
+#ifndef MOUSEKEY_MOVE_DELTA
+#   define MOUSEKEY_MOVE_DELTA 1
+#endif
+#ifndef MOUSEKEY_MAX_SPEED
+#   define MOUSEKEY_MAX_SPEED 10
+#endif
+#ifndef MOUSEKEY_TIME_TO_MAX
+#   define MOUSEKEY_TIME_TO_MAX 1000
+#endif
+#ifndef MOUSEKEY_WHEEL_DELAY
+#   define MOUSEKEY_WHEEL_DELAY MOUSEKEY_DELAY
+#endif
+#ifndef MOUSEKEY_WHEEL_INTERVAL
+#   define MOUSEKEY_WHEEL_INTERVAL 100
+#endif
+#ifndef MOUSEKEY_WHEEL_DELTA
+#   define MOUSEKEY_WHEEL_DELTA 1
+#endif
+#ifndef MOUSEKEY_WHEEL_MAX_SPEED
+#   define MOUSEKEY_WHEEL_MAX_SPEED 4
+#endif
+#ifndef MOUSEKEY_WHEEL_TIME_TO_MAX
+#   define MOUSEKEY_WHEEL_TIME_TO_MAX 2000
+#endif
+
+#if (MOUSEKEY_MAX_SPEED > 127 || MOUSEKEY_WHEEL_MAX_SPEED > 127)
+#   error "MOUSEKEY_MAX_SPEED and MOUSEKEY_WHEEL_MAX_SPEED must be 127 or less."
+#endif
+
 void mousekey_decode(uint8_t code);
 bool mousekey_changed(void);
 void mousekey_send(void);
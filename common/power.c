@@ -0,0 +1,84 @@
+/*
+Copyright 2011 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include "timer.h"
+#include "matrix.h"
+#include "power.h"
+
+
+#define TIMER_RAW_PERIOD    ((uint16_t)TIMER_RAW_TOP + 1)   // raw counts of 1ms
+
+uint8_t power_duty = 100;
+
+static uint16_t last_active = 0;
+static uint16_t last_scan = 0;
+static uint16_t window_start = 0;
+static uint32_t slept_raw = 0;      // sleep time in Timer0 counts
+
+
+static void sleep_once(void)
+{
+    uint16_t count0, count1;
+    uint8_t raw0, raw1;
+
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    cli();
+    count0 = timer_count;
+    raw0 = TIMER_RAW;
+    sleep_enable();
+    sei();
+    sleep_cpu();    // interrupt handler runs before we return here
+    sleep_disable();
+    cli();
+    count1 = timer_count;
+    raw1 = TIMER_RAW;
+    sei();
+
+    slept_raw += (uint32_t)(uint16_t)(count1 - count0) * TIMER_RAW_PERIOD + raw1 - raw0;
+}
+
+void power_idle(void)
+{
+    uint16_t now = timer_read();
+
+    if (matrix_is_modified() || matrix_key_count()) {
+        last_active = now;
+    }
+
+    uint16_t window = TIMER_DIFF_MS(now, window_start);
+    if (window >= 1000) {
+        uint32_t total = (uint32_t)window * TIMER_RAW_PERIOD;
+        if (slept_raw > total) slept_raw = total;
+        power_duty = 100 - (uint8_t)(slept_raw * 100 / total);
+        slept_raw = 0;
+        window_start = now;
+    }
+
+    if (TIMER_DIFF_MS(now, last_active) < POWER_ACTIVE_TIME) {
+        last_scan = now;
+        return;
+    }
+
+    while (timer_elapsed(last_scan) < POWER_SCAN_INTERVAL) {
+        sleep_once();
+    }
+    last_scan = timer_read();
+}
@@ -0,0 +1,50 @@
+/*
+Copyright 2011 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef POWER_H
+#define POWER_H 1
+
+#include <stdint.h>
+
+
+/*
+ * Idle sleep between matrix scans(POWER_SAVE_ENABLE)
+ *
+ * power_idle() is called after keyboard_proc() in main loop. While keys are
+ * pressed and for POWER_ACTIVE_TIME after last change it returns at once and
+ * matrix is scanned at full speed. Otherwise CPU sleeps in idle mode until
+ * POWER_SCAN_INTERVAL has passed since last scan. Timer0 wakes it every 1ms
+ * and USB, PS/2 and UART interrupts wake it as well.
+ */
+
+/* scan interval(ms) while no key is active */
+#ifndef POWER_SCAN_INTERVAL
+#   define POWER_SCAN_INTERVAL  1
+#endif
+
+/* time(ms) to keep full speed scan after last key activity */
+#ifndef POWER_ACTIVE_TIME
+#   define POWER_ACTIVE_TIME    1000
+#endif
+
+
+/* percentage of time CPU was awake in last second */
+extern uint8_t power_duty;
+
+void power_idle(void);
+
+#endif
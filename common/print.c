@@ -91,3 +91,44 @@ void pbin_reverse(unsigned char c)
         sendchar((c & (1<<i)) ? '1' : '0');
     }
 }
+
+// tiny formatter for debugf(): %02X, %04X, %08b and %%
+void print_fmt_P(const char *fmt, uint16_t a, uint16_t b)
+{
+	if (!print_enable) return;
+	char c;
+	uint8_t width;
+	uint8_t n = 0;
+	uint16_t v;
+
+	while (1) {
+		c = pgm_read_byte(fmt++);
+		if (!c) break;
+		if (c != '%') {
+			if (c == '\n') sendchar('\r');
+			sendchar(c);
+			continue;
+		}
+		width = 0;
+		while (1) {
+			c = pgm_read_byte(fmt++);
+			if (c < '0' || '9' < c) break;
+			width = width * 10 + (c - '0');
+		}
+		if (c == '%') {
+			sendchar('%');
+			continue;
+		}
+		v = (n++ ? b : a);
+		if (c == 'X') {
+			if (width > 2)
+				phex16(v);
+			else
+				phex(v);
+		} else if (c == 'b') {
+			pbin(v);
+		} else {
+			break;
+		}
+	}
+}
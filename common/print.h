@@ -41,5 +41,6 @@ void phex(unsigned char c);
 void phex16(unsigned int i);
 void pbin(unsigned char c);
 void pbin_reverse(unsigned char c);
+void print_fmt_P(const char *fmt, uint16_t a, uint16_t b);
 
 #endif
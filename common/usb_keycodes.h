@@ -58,6 +58,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define KB_MINS KB_MINUS
 #define KB_EQL  KB_EQUAL
 #define KB_GRV  KB_GRAVE
+#define KB_TRNS KB_TRANSPARENT
 #define KB_RBRC KB_RBRACKET
 #define KB_LBRC KB_LBRACKET
 #define KB_COMM KB_COMMA
@@ -161,6 +162,9 @@ enum special_keycodes {
     KB_WWW_REFRESH,
     KB_WWW_FAVORITES,
 
+    /* Layer: use keycode of lower active layer */
+    KB_TRANSPARENT = 0xDF,
+
     /* reserve 0xE0-E7 for Modifiers */
 
     /* Layer Switching */
@@ -106,6 +106,8 @@ static const uint8_t PROGMEM fn_keycode[] = {
     KB_NO           // Fn7
 };
 
+// dense keymap, converted by tool/keymap_pack.py when packed
+#if !defined(KEYMAP_PACK_ENABLE) || defined(KEYMAP_PACK_DENSE)
 static const uint8_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
     /* Default Layer: plain keymap
      * ,---.   ,---------------. ,---------------. ,---------------. ,-----------.             ,---.
@@ -157,12 +159,15 @@ static const uint8_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
     LCTL,LGUI,LALT,          SPC,                                              HOME,PGDN,END,     BTN1,     BTN2,BTN3
     ),
 };
+#endif
 
 
+#ifndef KEYMAP_PACK_ENABLE
 uint8_t keymap_get_keycode(uint8_t layer, uint8_t row, uint8_t col)
 {
     return KEYCODE(layer, row, col);
 }
+#endif
 
 uint8_t keymap_fn_layer(uint8_t fn_bits)
 {
@@ -29,6 +29,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "led.h"
 #include "adb.h"
 #include "matrix.h"
+#ifdef MATRIX_HAS_GHOST
+#   include "ghost.h"
+#endif
 
 
 #if (MATRIX_COLS > 16)
@@ -55,9 +58,6 @@ static uint16_t *matrix;
 static uint16_t _matrix0[MATRIX_ROWS];
 #endif
 
-#ifdef MATRIX_HAS_GHOST
-static bool matrix_has_ghost_in_row(uint8_t row);
-#endif
 static void _register_key(uint8_t key);
 
 
@@ -151,12 +151,10 @@ inline
 bool matrix_has_ghost(void)
 {
 #ifdef MATRIX_HAS_GHOST
-    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
-        if (matrix_has_ghost_in_row(i))
-            return true;
-    }
-#endif
+    return ghost_exists();
+#else
     return false;
+#endif
 }
 
 inline
@@ -190,7 +188,7 @@ void matrix_print(void)
         pbin_reverse16(matrix_get_row(row));
 #endif
 #ifdef MATRIX_HAS_GHOST
-        if (matrix_has_ghost_in_row(row)) {
+        if (ghost_get_row(row)) {
             print(" <ghost");
         }
 #endif
@@ -211,23 +209,6 @@ uint8_t matrix_key_count(void)
     return count;
 }
 
-#ifdef MATRIX_HAS_GHOST
-inline
-static bool matrix_has_ghost_in_row(uint8_t row)
-{
-    // no ghost exists in case less than 2 keys on
-    if (((matrix[row] - 1) & matrix[row]) == 0)
-        return false;
-
-    // ghost exists in case same state as other row
-    for (uint8_t i=0; i < MATRIX_ROWS; i++) {
-        if (i != row && (matrix[i] & matrix[row]) == matrix[row])
-            return true;
-    }
-    return false;
-}
-#endif
-
 inline
 static void _register_key(uint8_t key)
 {
@@ -100,6 +100,8 @@ static const uint8_t PROGMEM fn_keycode[] = {
 #endif
 };
 
+// dense keymap, converted by tool/keymap_pack.py when packed
+#if !defined(KEYMAP_PACK_ENABLE) || defined(KEYMAP_PACK_DENSE)
 static const uint8_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
     /* 
      * The keymap works with both M0110 and M0110A keyboards. As you can see, the M0110A is a superset
@@ -196,12 +198,15 @@ static const uint8_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
     ),
 #endif
 };
+#endif
 
 
+#ifndef KEYMAP_PACK_ENABLE
 uint8_t keymap_get_keycode(uint8_t layer, uint8_t row, uint8_t col)
 {
     return KEYCODE(layer, row, col);
 }
+#endif
 
 uint8_t keymap_fn_layer(uint8_t fn_bits)
 {
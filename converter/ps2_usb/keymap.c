@@ -199,6 +199,8 @@ static const uint8_t PROGMEM fn_keycode[] = {
 // The keymap is a 32*8 byte array which convert a PS/2 scan code into a USB keycode.
 // See usb_keycodes.h for USB keycodes. You should omit a 'KB_' prefix of USB keycodes in keymap macro.
 // Use KEYMAP_ISO() or KEYMAP_JIS() instead of KEYMAP() if your keyboard is ISO or JIS.
+// dense keymap, converted by tool/keymap_pack.py when packed
+#if !defined(KEYMAP_PACK_ENABLE) || defined(KEYMAP_PACK_DENSE)
 static const uint8_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
     /* 0: default
      * ,---.   ,---------------. ,---------------. ,---------------. ,-----------.     ,-----------.
@@ -361,12 +363,15 @@ static const uint8_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
     LCTL,LGUI,LALT,          SPC,                     RALT,RGUI,APP, RCTL,     LEFT,DOWN,RGHT,    P0,       PDOT,PENT
     ),
 };
+#endif
 
 
+#ifndef KEYMAP_PACK_ENABLE
 uint8_t keymap_get_keycode(uint8_t layer, uint8_t row, uint8_t col)
 {
     return pgm_read_byte(&keymaps[(layer)][(row)][(col)]);
 }
+#endif
 
 uint8_t keymap_fn_layer(uint8_t fn_bits)
 {
@@ -23,14 +23,31 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "util.h"
 #include "debug.h"
 #include "ps2.h"
+#include "timer.h"
+#include "host.h"
+#include "led.h"
 #include "matrix.h"
+#ifdef MATRIX_HAS_GHOST
+#   include "ghost.h"
+#endif
+
+
+/* keyboard is probed with ECHO after this silence(ms) */
+#ifndef PS2_PRESENCE_INTERVAL
+#   define PS2_PRESENCE_INTERVAL 3000
+#endif
+/* probe interval doubles up to this while keyboard is missing(ms) */
+#ifndef PS2_PRESENCE_INTERVAL_MAX
+#   define PS2_PRESENCE_INTERVAL_MAX 8000
+#endif
 
 
 static void matrix_make(uint8_t code);
 static void matrix_break(uint8_t code);
-#ifdef MATRIX_HAS_GHOST
-static bool matrix_has_ghost_in_row(uint8_t row);
-#endif
+static void matrix_clear(void);
+static void keyboard_setup(void);
+static void presence_probe(void);
+static bool presence_poll(void);
 
 
 /*
@@ -68,6 +85,20 @@ static uint8_t matrix[MATRIX_ROWS];
 
 static bool is_modified = false;
 
+/* last make code decoded, its typematic repeats are dropped */
+static uint8_t last_make = 0;
+
+/* keyboard presence monitor */
+static bool keyboard_present = true;
+static uint16_t last_activity = 0;
+static uint16_t presence_interval = PS2_PRESENCE_INTERVAL;
+static bool presence_pending = false;
+static uint16_t presence_time = 0;
+
+/* keyboard_setup() waits for responses with USART interrupt, which is not
+ * enabled yet in matrix_init() on V-USB. First matrix_scan() does it. */
+static bool setup_pending = true;
+
 
 inline
 uint8_t matrix_rows(void)
@@ -88,6 +119,7 @@ void matrix_init(void)
     // initialize matrix state: all keys off
     for (uint8_t i=0; i < MATRIX_ROWS; i++) matrix[i] = 0x00;
 
+    last_activity = timer_read();
     return;
 }
 
@@ -185,8 +217,38 @@ uint8_t matrix_scan(void)
         matrix_break(PAUSE);
     }
 
+    if (setup_pending) {
+        setup_pending = false;
+        keyboard_setup();
+    }
+
     uint8_t code;
     while ((code = ps2_host_recv())) {
+        last_activity = timer_read();
+        keyboard_present = true;
+        presence_interval = PS2_PRESENCE_INTERVAL;
+
+        // keyboard was plugged in, reset or has lost keys
+        switch (code) {
+            case PS2_BAT_OK:
+                debug("PS/2 keyboard: BAT\n");
+                matrix_clear();
+                keyboard_setup();
+                state = INIT;
+                continue;
+            case PS2_BAT_ERR:
+                debug("PS/2 keyboard: BAT error\n");
+                matrix_clear();
+                ps2_host_send(PS2_RESET);   // BAT again
+                state = INIT;
+                continue;
+            case PS2_KBD_ERROR:
+                debug("PS/2 keyboard: key detection error/overrun\n");
+                matrix_clear();
+                state = INIT;
+                continue;
+        }
+
         switch (state) {
             case INIT:
                 switch (code) {
@@ -357,8 +419,17 @@ uint8_t matrix_scan(void)
             default:
                 state = INIT;
         }
-        phex(code);
     }
+
+    // probe and LED update take turns as both wait for a response
+    if (presence_pending) {
+        if (presence_poll()) state = INIT;
+    } else if (timer_elapsed(last_activity) > presence_interval && !ps2_host_led_busy()) {
+        presence_probe();
+    }
+
+    // LED update requested by led_set()
+    if (!presence_pending) ps2_host_led_task();
     return 1;
 }
 
@@ -371,12 +442,10 @@ inline
 bool matrix_has_ghost(void)
 {
 #ifdef MATRIX_HAS_GHOST
-    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
-        if (matrix_has_ghost_in_row(i))
-            return true;
-    }
-#endif
+    return ghost_exists();
+#else
     return false;
+#endif
 }
 
 inline
@@ -398,7 +467,7 @@ void matrix_print(void)
         phex(row); print(": ");
         pbin_reverse(matrix_get_row(row));
 #ifdef MATRIX_HAS_GHOST
-        if (matrix_has_ghost_in_row(row)) {
+        if (ghost_get_row(row)) {
             print(" <ghost");
         }
 #endif
@@ -415,27 +484,14 @@ uint8_t matrix_key_count(void)
     return count;
 }
 
-#ifdef MATRIX_HAS_GHOST
-inline
-static bool matrix_has_ghost_in_row(uint8_t row)
-{
-    // no ghost exists in case less than 2 keys on
-    if (((matrix[row] - 1) & matrix[row]) == 0)
-        return false;
-
-    // ghost exists in case same state as other row
-    for (uint8_t i=0; i < MATRIX_ROWS; i++) {
-        if (i != row && (matrix[i] & matrix[row]) == matrix[row])
-            return true;
-    }
-    return false;
-}
-#endif
-
 
 inline
 static void matrix_make(uint8_t code)
 {
+    // typematic repeat
+    if (code == last_make) return;
+    last_make = code;
+
     if (!matrix_is_on(ROW(code), COL(code))) {
         matrix[ROW(code)] |= 1<<COL(code);
         is_modified = true;
@@ -445,8 +501,79 @@ static void matrix_make(uint8_t code)
 inline
 static void matrix_break(uint8_t code)
 {
+    if (code == last_make) last_make = 0;
     if (matrix_is_on(ROW(code), COL(code))) {
         matrix[ROW(code)] &= ~(1<<COL(code));
         is_modified = true;
     }
 }
+
+/* release all keys, keys on keyboard side have been lost */
+static void matrix_clear(void)
+{
+    last_make = 0;
+    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+        if (matrix[i]) {
+            matrix[i] = 0x00;
+            is_modified = true;
+        }
+    }
+}
+
+/* restore settings keyboard forgets with reset */
+static void keyboard_setup(void)
+{
+    // Scan Code Set 2
+    if (ps2_host_send(0xF0) == PS2_ACK) {
+        ps2_host_send(0x02);
+    }
+    // Slowest typematic: 2cps after 1000ms. USB host repeats keys by itself.
+    // (Make/Break only mode(F8) is available only in Set 3.)
+    if (ps2_host_send(PS2_SET_TYPEMATIC) == PS2_ACK) {
+        ps2_host_send(0x7F);
+    }
+    led_set(host_keyboard_leds());
+}
+
+/* keyboard is silent: unplugged or just idle?
+ * ECHO is sent without waiting and its response is taken by later scans.
+ * Sending still blocks until timeout when keyboard is missing, so it is sent
+ * less often then. Plugged keyboard is found by its BAT anyway. */
+static void presence_probe(void)
+{
+    // no response comes when send fails
+    ps2_host_send_async(PS2_ECHO);
+    presence_pending = true;
+    presence_time = timer_read();
+}
+
+/* returns true when probe is done */
+static bool presence_poll(void)
+{
+    uint8_t res = ps2_host_poll_response();
+    if (!res) {
+        if (timer_elapsed(presence_time) <= PS2_RESPONSE_TIMEOUT) return false;
+        ps2_host_cancel_response();
+    }
+    presence_pending = false;
+
+    bool present = (res == PS2_ECHO);
+    if (present && !keyboard_present) {
+        // came back without BAT, state is unknown
+        debug("PS/2 keyboard: found\n");
+        keyboard_setup();
+    } else if (!present && keyboard_present) {
+        debug("PS/2 keyboard: lost\n");
+        matrix_clear();
+    }
+    keyboard_present = present;
+    if (present) {
+        presence_interval = PS2_PRESENCE_INTERVAL;
+    } else if (presence_interval < PS2_PRESENCE_INTERVAL_MAX / 2) {
+        presence_interval *= 2;
+    } else {
+        presence_interval = PS2_PRESENCE_INTERVAL_MAX;
+    }
+    last_activity = timer_read();
+    return true;
+}
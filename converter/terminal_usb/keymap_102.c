@@ -96,6 +96,8 @@ static const uint8_t PROGMEM fn_keycode[] = {
 };
 
 
+// dense keymap, converted by tool/keymap_pack.py when packed
+#if !defined(KEYMAP_PACK_ENABLE) || defined(KEYMAP_PACK_DENSE)
 static const uint8_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
     /* 0: default
      * ,---.   ,---------------. ,---------------. ,---------------. ,-----------.
@@ -190,12 +192,15 @@ static const uint8_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
     LGUI,     LALT,               SPC,                          RALT,     RCTL,     LEFT,DOWN,RGHT,    NO,  P0,  PDOT,NO
     ),
 };
+#endif
 
 
+#ifndef KEYMAP_PACK_ENABLE
 uint8_t keymap_get_keycode(uint8_t layer, uint8_t row, uint8_t col)
 {
     return pgm_read_byte(&keymaps[(layer)][(row)][(col)]);
 }
+#endif
 
 uint8_t keymap_fn_layer(uint8_t fn_bits)
 {
@@ -29,5 +29,6 @@ void led_set(uint8_t usb_led)
         ps2_led |= (1<<PS2_LED_NUM_LOCK);
     if (usb_led &  (1<<USB_LED_CAPS_LOCK))
         ps2_led |= (1<<PS2_LED_CAPS_LOCK);
-    ps2_host_set_led(ps2_led);
+    // sent by matrix_scan() later
+    ps2_host_set_led_async(ps2_led);
 }
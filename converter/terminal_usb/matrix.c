@@ -24,13 +24,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "debug.h"
 #include "ps2.h"
 #include "matrix.h"
+#ifdef MATRIX_HAS_GHOST
+#   include "ghost.h"
+#endif
 
 
 static void matrix_make(uint8_t code);
 static void matrix_break(uint8_t code);
-#ifdef MATRIX_HAS_GHOST
-static bool matrix_has_ghost_in_row(uint8_t row);
-#endif
 
 
 /*
@@ -133,6 +133,9 @@ uint8_t matrix_scan(void)
                 break;
         }
     }
+
+    // LED update requested by led_set()
+    ps2_host_led_task();
     return 1;
 }
 
@@ -145,12 +148,10 @@ inline
 bool matrix_has_ghost(void)
 {
 #ifdef MATRIX_HAS_GHOST
-    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
-        if (matrix_has_ghost_in_row(i))
-            return true;
-    }
-#endif
+    return ghost_exists();
+#else
     return false;
+#endif
 }
 
 inline
@@ -172,7 +173,7 @@ void matrix_print(void)
         phex(row); print(": ");
         pbin_reverse(matrix_get_row(row));
 #ifdef MATRIX_HAS_GHOST
-        if (matrix_has_ghost_in_row(row)) {
+        if (ghost_get_row(row)) {
             print(" <ghost");
         }
 #endif
@@ -189,23 +190,6 @@ uint8_t matrix_key_count(void)
     return count;
 }
 
-#ifdef MATRIX_HAS_GHOST
-inline
-static bool matrix_has_ghost_in_row(uint8_t row)
-{
-    // no ghost exists in case less than 2 keys on
-    if (((matrix[row] - 1) & matrix[row]) == 0)
-        return false;
-
-    // ghost exists in case same state as other row
-    for (uint8_t i=0; i < MATRIX_ROWS; i++) {
-        if (i != row && (matrix[i] & matrix[row]) == matrix[row])
-            return true;
-    }
-    return false;
-}
-#endif
-
 
 inline
 static void matrix_make(uint8_t code)
@@ -23,6 +23,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "debug.h"
 #include "util.h"
 #include "matrix.h"
+#ifdef MATRIX_HAS_GHOST
+#   include "ghost.h"
+#endif
 
 
 /*
@@ -59,9 +62,6 @@ static uint16_t _matrix0[MATRIX_ROWS];
 static uint16_t _matrix1[MATRIX_ROWS];
 #endif
 
-#ifdef MATRIX_HAS_GHOST
-static bool matrix_has_ghost_in_row(uint8_t row);
-#endif
 static uint8_t read_col(void);
 static void unselect_rows(void);
 static void select_row(uint8_t row);
@@ -151,12 +151,10 @@ inline
 bool matrix_has_ghost(void)
 {
 #ifdef MATRIX_HAS_GHOST
-    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
-        if (matrix_has_ghost_in_row(i))
-            return true;
-    }
-#endif
+    return ghost_exists();
+#else
     return false;
+#endif
 }
 
 inline
@@ -186,7 +184,7 @@ void matrix_print(void)
         pbin_reverse16(matrix_get_row(row));
 #endif
 #ifdef MATRIX_HAS_GHOST
-        if (matrix_has_ghost_in_row(row)) {
+        if (ghost_get_row(row)) {
             print(" <ghost");
         }
 #endif
@@ -207,23 +205,6 @@ uint8_t matrix_key_count(void)
     return count;
 }
 
-#ifdef MATRIX_HAS_GHOST
-inline
-static bool matrix_has_ghost_in_row(uint8_t row)
-{
-    // no ghost exists in case less than 2 keys on
-    if (((matrix[row] - 1) & matrix[row]) == 0)
-        return false;
-
-    // ghost exists in case same state as other row
-    for (uint8_t i=0; i < MATRIX_ROWS; i++) {
-        if (i != row && (matrix[i] & matrix[row]) == matrix[row])
-            return true;
-    }
-    return false;
-}
-#endif
-
 inline
 static uint8_t read_col(void)
 {
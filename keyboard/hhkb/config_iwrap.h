@@ -40,6 +40,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #   define MOUSEKEY_DELAY_TIME 255
 #endif
 
+/* unused pins: pulled up to save power */
+#define UNUSED_PINS_D   0xE0    // PD5-7
+
+
 /* pins for Software UART */
 #define SUART_IN_PIN    PINC
 #define SUART_IN_BIT    5
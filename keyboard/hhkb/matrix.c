@@ -27,6 +27,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "util.h"
 #include "timer.h"
 #include "matrix.h"
+#ifdef MATRIX_HAS_GHOST
+#   include "ghost.h"
+#endif
+#ifdef HOST_VUSB
+#   include "usbdrv.h"
+#endif
 
 
 // Timer resolution check
@@ -41,6 +47,39 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #   error "MATRIX_ROWS must not exceed 255"
 #endif
 
+// KEY_STATE is sampled by Timer0 compare B interrupt after KEY_ENABLE.
+// It is valid only in 20us after KEY_ENABLE and needs 10us to output its
+// value, so sample at the first timer tick which is surely 10us later.
+// Timer0 counts 0 to TIMER_RAW_TOP in CTC mode.
+#define RAW_PERIOD      (TIMER_RAW_TOP + 1)
+#define SAMPLE_RAW      ((10 * TIMER_RAW_FREQ + 999999) / 1000000 + 1)
+#if (SAMPLE_RAW * 1000000 / TIMER_RAW_FREQ > 20)
+#   error "Timer resolution is not enough to sample KEY_STATE in its 20us window."
+#endif
+
+// Times to sample a key again when the sample is out of its window.
+#ifndef KEY_RETRY
+#   define KEY_RETRY    3
+#endif
+
+// Host starts transactions just after SOF(keep-alive on low speed) and
+// V-USB interrupt takes tens of microseconds to process them. Wait for
+// the traffic to pass when new frame has started since last sample.
+#if defined(HOST_VUSB) && USB_COUNT_SOF
+#   ifndef KEY_SOF_GUARD_US
+#       define KEY_SOF_GUARD_US     100
+#   endif
+static uint8_t last_sof = 0;
+#   define KEY_SYNC()   do {                \
+    if (usbSofCount != last_sof) {          \
+        _delay_us(KEY_SOF_GUARD_US);        \
+        last_sof = usbSofCount;             \
+    }                                       \
+} while (0)
+#else
+#   define KEY_SYNC()
+#endif
+
 
 // matrix state buffer(1:on, 0:off)
 #if (MATRIX_COLS <= 8)
@@ -55,10 +94,27 @@ static uint16_t _matrix0[MATRIX_ROWS];
 static uint16_t _matrix1[MATRIX_ROWS];
 #endif
 
+// Keys which exist on HHKB(positions of KB_NO in KEYMAP are not scanned)
+static const uint8_t key_exists[MATRIX_ROWS] = {
+    0xFF, 0xFF, 0x7F, 0xFF, 0x7F, 0xFF, 0x7F, 0x7F
+};
+
+// full scans in last second
+uint16_t matrix_scan_rate = 0;
+static uint16_t scan_count = 0;
+static uint16_t scan_timer = 0;
+
+// samples taken out of the window and retried
+uint16_t matrix_sample_discarded = 0;
+// keys left as previous state because all retries failed
+uint16_t matrix_sample_dropped = 0;
+
+static volatile uint8_t sample_start;
+static volatile uint8_t sample_state;
+static volatile bool sample_late;
+static volatile bool sample_done;
+
 // HHKB has no ghost and no bounce.
-#ifdef MATRIX_HAS_GHOST
-static bool matrix_has_ghost_in_row(uint8_t row);
-#endif
 
 
 // Matrix I/O ports
@@ -163,6 +219,12 @@ uint8_t matrix_scan(void)
     KEY_POWER_ON();
     for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
         for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+            if (!(key_exists[row] & (1<<col))) continue;
+
+            // NOTE: KEY_STATE keep its state in 20us after KEY_ENABLE.
+            // This takes 25us or more to make sure KEY_STATE returns to idle state.
+            // Selecting next key and waiting for it to settle covers that
+            // recovery time of previous key, no need to wait separately.
             KEY_SELECT(row, col);
             _delay_us(40);
 
@@ -175,34 +237,67 @@ uint8_t matrix_scan(void)
             // NOTE: KEY_STATE is valid only in 20us after KEY_ENABLE.
             // If V-USB interrupts in this section we could lose 40us or so
             // and would read invalid value from KEY_STATE.
-            uint8_t last = TIMER_RAW;
+            uint8_t retry = KEY_RETRY;
+            while (true) {
+                KEY_SYNC();
+                uint8_t sreg = SREG;
+                cli();
+                sample_start = TIMER_RAW;
+                OCR0B = (sample_start + SAMPLE_RAW) % RAW_PERIOD;
+                TIFR0 = (1<<OCF0B);
+                sample_done = false;
+                TIMSK0 |= (1<<OCIE0B);
+                KEY_ENABLE();
+                SREG = sreg;
+                while (!sample_done) ;
+
+                if (!sample_late || !retry--) break;
+
+                // Sample this key again after KEY_STATE returns to idle state.
+                matrix_sample_discarded++;
+                KEY_UNABLE();
+                _delay_us(30);
+            }
 
-            KEY_ENABLE();
-            // Wait for KEY_STATE outputs its value.
-            // 1us was ok on one HHKB, but not worked on another.
-            _delay_us(10);
-            if (KEY_STATE()) {
+            if (sample_late) {
+                // keep previous state of this key only
+                matrix_sample_dropped++;
+                if (matrix_prev[row] & (1<<col)) {
+                    matrix[row] |= (1<<col);
+                } else {
+                    matrix[row] &= ~(1<<col);
+                }
+            } else if (sample_state) {
                 matrix[row] &= ~(1<<col);
             } else {
                 matrix[row] |= (1<<col);
             }
 
-            // Ignore if this code region execution time elapses more than 20us.
-            if (TIMER_DIFF_RAW(TIMER_RAW, last) > 20/(1000000/TIMER_RAW_FREQ)) {
-                matrix[row] = matrix_prev[row];
-            }
-
             KEY_PREV_OFF();
             KEY_UNABLE();
-            // NOTE: KEY_STATE keep its state in 20us after KEY_ENABLE.
-            // This takes 25us or more to make sure KEY_STATE returns to idle state.
-            _delay_us(150);
         }
     }
     KEY_POWER_OFF();
+
+    scan_count++;
+    if (timer_elapsed(scan_timer) >= 1000) {
+        matrix_scan_rate = scan_count;
+        scan_count = 0;
+        scan_timer = timer_read();
+    }
     return 1;
 }
 
+// Samples KEY_STATE in its valid window and tells whether it was late.
+ISR(TIMER0_COMPB_vect)
+{
+    sample_state = KEY_STATE();
+    uint8_t elapsed = TIMER_DIFF(TIMER_RAW, sample_start, RAW_PERIOD);
+    sample_late = (elapsed > SAMPLE_RAW);
+    TIMSK0 &= ~(1<<OCIE0B);
+    sample_done = true;
+}
+
 bool matrix_is_modified(void)
 {
     for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
@@ -216,12 +311,10 @@ inline
 bool matrix_has_ghost(void)
 {
 #ifdef MATRIX_HAS_GHOST
-    for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
-        if (matrix_has_ghost_in_row(i))
-            return true;
-    }
-#endif
+    return ghost_exists();
+#else
     return false;
+#endif
 }
 
 inline
@@ -255,12 +348,15 @@ void matrix_print(void)
         pbin_reverse16(matrix_get_row(row));
 #endif
 #ifdef MATRIX_HAS_GHOST
-        if (matrix_has_ghost_in_row(row)) {
+        if (ghost_get_row(row)) {
             print(" <ghost");
         }
 #endif
         print("\n");
     }
+    print("scan rate: "); phex16(matrix_scan_rate); print("/s\n");
+    print("sample discarded: "); phex16(matrix_sample_discarded); print("\n");
+    print("sample dropped: "); phex16(matrix_sample_dropped); print("\n");
 }
 
 uint8_t matrix_key_count(void)
@@ -276,19 +372,3 @@ uint8_t matrix_key_count(void)
     return count;
 }
 
-#ifdef MATRIX_HAS_GHOST
-inline
-static bool matrix_has_ghost_in_row(uint8_t row)
-{
-    // no ghost exists in case less than 2 keys on
-    if (((matrix[row] - 1) & matrix[row]) == 0)
-        return false;
-
-    // ghost exists in case same state as other row
-    for (uint8_t i=0; i < MATRIX_ROWS; i++) {
-        if (i != row && (matrix[i] & matrix[row]) == matrix[row])
-            return true;
-    }
-    return false;
-}
-#endif
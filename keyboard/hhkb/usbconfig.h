@@ -109,10 +109,15 @@ section at the end of this file).
  * (e.g. HID), but never want to send any data. This option saves a couple
  * of bytes in flash memory and the transmit buffers in RAM.
  */
+#ifdef USB_POLLING_INTERVAL
+#define USB_CFG_INTR_POLL_INTERVAL      USB_POLLING_INTERVAL
+#else
 #define USB_CFG_INTR_POLL_INTERVAL      10
+#endif
 /* If you compile a version with endpoint 1 (interrupt-in), this is the poll
  * interval. The value is in milliseconds and must not be less than 10 ms for
- * low speed devices.
+ * low speed devices. Set USB_POLLING_INTERVAL in config.h to override it;
+ * it can also be changed at runtime with vusb_set_polling_interval().
  */
 #define USB_CFG_IS_SELF_POWERED         0
 /* Define this to 1 if the device has its own power supply. Set it to 0 if the
@@ -345,7 +350,7 @@ section at the end of this file).
  */
 
 #define USB_CFG_DESCR_PROPS_DEVICE                  0
-#define USB_CFG_DESCR_PROPS_CONFIGURATION           USB_PROP_IS_DYNAMIC
+#define USB_CFG_DESCR_PROPS_CONFIGURATION           (USB_PROP_IS_DYNAMIC | USB_PROP_IS_RAM)
 //#define USB_CFG_DESCR_PROPS_CONFIGURATION           0
 #define USB_CFG_DESCR_PROPS_STRINGS                 0
 #define USB_CFG_DESCR_PROPS_STRING_0                0
@@ -35,6 +35,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "report.h"
 #include "host_driver.h"
 #include "iwrap.h"
+#include "timer.h"
 #include "print.h"
 
 
@@ -48,7 +49,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define MUX_FOOTER(LINK) xmit(LINK^0xff)
 
 
-static uint8_t connected = 0;
+/* updated by iwrap_check_connection() and events of iWRAP in ISR */
+static volatile uint8_t connected = 0;
+static uint8_t sent = 0;
 //static uint8_t channel = 1;
 
 /* iWRAP buffer */
@@ -96,6 +99,32 @@ static void rcv_clear(void)
     rcv_tail = rcv_head = 0;
 }
 
+/* iWRAP event
+ * Unsolicited events on control link tell connection state:
+ *     RING 0 xx:xx:xx:xx:xx:xx 11 HID      // host connected
+ *     CONNECT 0 HID 11                     // CALL succeeded
+ *     NO CARRIER 0 ERROR 0                 // link closed
+ * Only start of line is kept as it is parsed in ISR.
+ */
+#define EVENT_LEN 10
+static char event[EVENT_LEN];
+static uint8_t event_pos = 0;
+
+static inline void event_char(char c)
+{
+    if (c == '\r' || c == '\n') {
+        if ((event_pos >= 4 && !strncmp(event, "RING", 4)) ||
+                (event_pos >= 7 && !strncmp(event, "CONNECT", 7))) {
+            connected = 1;
+        } else if (event_pos >= 10 && !strncmp(event, "NO CARRIER", 10)) {
+            connected = 0;
+        }
+        event_pos = 0;
+    } else if (event_pos < EVENT_LEN) {
+        event[event_pos++] = c;
+    }
+}
+
 /* iWRAP response */
 ISR(PCINT1_vect, ISR_BLOCK) // recv() runs away in case of ISR_NOBLOCK
 {
@@ -128,6 +157,7 @@ ISR(PCINT1_vect, ISR_BLOCK) // recv() runs away in case of ISR_NOBLOCK
             if (mux_state--) {
                 uart_putchar(c);
                 rcv_enq(c);
+                if (mux_link == 0xff) event_char(c);
             }
     }
 }
@@ -288,6 +318,11 @@ uint8_t iwrap_connected(void)
     return connected;
 }
 
+uint8_t iwrap_sent(void)
+{
+    return sent;
+}
+
 uint8_t iwrap_check_connection(void)
 {
     iwrap_mux_send("LIST");
@@ -301,6 +336,85 @@ uint8_t iwrap_check_connection(void)
 }
 
 
+/*------------------------------------------------------------------*
+ * Report queue
+ *------------------------------------------------------------------*/
+/* Reports are queued and sent in order while connected. During reconnect
+ * they are kept for IWRAP_QUEUE_TIMEOUT ms, and the oldest one is dropped
+ * when the queue is full.
+ */
+#ifndef IWRAP_QUEUE_SIZE
+#   define IWRAP_QUEUE_SIZE     8
+#endif
+#ifndef IWRAP_QUEUE_TIMEOUT
+#   define IWRAP_QUEUE_TIMEOUT  1000
+#endif
+
+#define REPORT_KEYBOARD 0x01
+#define REPORT_MOUSE    0x02
+#define REPORT_CONSUMER 0x03
+
+typedef struct {
+    uint16_t time;
+    uint8_t id;
+    uint8_t data[8];
+} iwrap_report_t;
+
+static iwrap_report_t queue[IWRAP_QUEUE_SIZE];
+static uint8_t queue_head = 0;
+static uint8_t queue_tail = 0;
+
+/* 3.10 HID raw mode(iWRAP_HID_Application_Note.pdf) */
+static void xmit_report(iwrap_report_t *r)
+{
+    uint8_t len = (r->id == REPORT_KEYBOARD ? 8 : 3);
+    MUX_HEADER(0x01, len + 4);
+    // HID raw mode header
+    xmit(0x9f);
+    xmit(len + 2);  // Length
+    xmit(0xa1);
+    xmit(r->id);
+    for (uint8_t i = 0; i < len; i++)
+        xmit(r->data[i]);
+    MUX_FOOTER(0x01);
+    sent++;
+}
+
+static iwrap_report_t *queue_new(uint8_t id)
+{
+    uint8_t next = (queue_head + 1) % IWRAP_QUEUE_SIZE;
+    if (next == queue_tail) {
+        // full: drop oldest
+        queue_tail = (queue_tail + 1) % IWRAP_QUEUE_SIZE;
+    }
+    iwrap_report_t *r = &queue[queue_head];
+    r->time = timer_read();
+    r->id = id;
+    queue_head = next;
+    return r;
+}
+
+static void queue_flush(void)
+{
+    while (queue_tail != queue_head) {
+        iwrap_report_t *r = &queue[queue_tail];
+        if (!connected) {
+            if (timer_elapsed(r->time) < IWRAP_QUEUE_TIMEOUT) return;
+            // too old to be sent
+        } else {
+            xmit_report(r);
+        }
+        queue_tail = (queue_tail + 1) % IWRAP_QUEUE_SIZE;
+    }
+}
+
+/* sends queued reports when connection comes back */
+void iwrap_task(void)
+{
+    queue_flush();
+}
+
+
 /*------------------------------------------------------------------*
  * Host driver
  *------------------------------------------------------------------*/
@@ -329,38 +443,22 @@ static uint8_t keyboard_leds(void) {
 
 static void send_keyboard(report_keyboard_t *report)
 {
-    if (!iwrap_connected() && !iwrap_check_connection()) return;
-    MUX_HEADER(0x01, 0x0c);
-    // HID raw mode header
-    xmit(0x9f);
-    xmit(0x0a); // Length
-    xmit(0xa1); // keyboard report
-    xmit(0x01);
-    xmit(report->mods);
-    xmit(0x00); // reserved byte(always 0)
-    xmit(report->keys[0]);
-    xmit(report->keys[1]);
-    xmit(report->keys[2]);
-    xmit(report->keys[3]);
-    xmit(report->keys[4]);
-    xmit(report->keys[5]);
-    MUX_FOOTER(0x01);
+    iwrap_report_t *r = queue_new(REPORT_KEYBOARD);
+    r->data[0] = report->mods;
+    r->data[1] = 0x00;  // reserved byte(always 0)
+    for (uint8_t i = 0; i < 6; i++)
+        r->data[2 + i] = report->keys[i];
+    queue_flush();
 }
 
 static void send_mouse(report_mouse_t *report)
 {
 #if defined(MOUSEKEY_ENABLE) || defined(PS2_MOUSE_ENABLE)
-    if (!iwrap_connected() && !iwrap_check_connection()) return;
-    MUX_HEADER(0x01, 0x07);
-    // HID raw mode header
-    xmit(0x9f);
-    xmit(0x05); // Length
-    xmit(0xa1); // mouse report
-    xmit(0x02);
-    xmit(report->buttons);
-    xmit(report->x);
-    xmit(report->y);
-    MUX_FOOTER(0x01);
+    iwrap_report_t *r = queue_new(REPORT_MOUSE);
+    r->data[0] = report->buttons;
+    r->data[1] = report->x;
+    r->data[2] = report->y;
+    queue_flush();
 #endif
 }
 
@@ -377,7 +475,6 @@ static void send_consumer(uint16_t data)
     uint8_t bits2 = 0;
     uint8_t bits3 = 0;
 
-    if (!iwrap_connected() && !iwrap_check_connection()) return;
     if (data == last_data) return;
     last_data = data;
 
@@ -454,14 +551,10 @@ static void send_consumer(uint16_t data)
             break;
     }
 
-    MUX_HEADER(0x01, 0x07);
-    xmit(0x9f);
-    xmit(0x05); // Length
-    xmit(0xa1); // consumer report
-    xmit(0x03);
-    xmit(bits1);
-    xmit(bits2);
-    xmit(bits3);
-    MUX_FOOTER(0x01);
+    iwrap_report_t *r = queue_new(REPORT_CONSUMER);
+    r->data[0] = bits1;
+    r->data[1] = bits2;
+    r->data[2] = bits3;
+    queue_flush();
 #endif
 }
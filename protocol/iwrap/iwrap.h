@@ -30,6 +30,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 host_driver_t *iwrap_driver(void);
 
 void iwrap_init(void);
+void iwrap_task(void);
 void iwrap_send(const char *s);
 void iwrap_mux_send(const char *s);
 void iwrap_buf_send(void);
@@ -45,5 +46,7 @@ void iwrap_subrate(void);
 bool iwrap_failed(void);
 uint8_t iwrap_connected(void);
 uint8_t iwrap_check_connection(void);
+/* count of reports sent to host, wraps around */
+uint8_t iwrap_sent(void);
 
 #endif
@@ -44,38 +44,39 @@ static uint8_t console_command(uint8_t c);
 static uint8_t key2asc(uint8_t key);
 
 
-/*
 static void set_prr(void)
 {
+    // ADC and analog comparator are running unless disabled
+    ADCSRA &= ~(1<<ADEN);
+    ACSR |= (1<<ACD);
     power_adc_disable();
     power_spi_disable();
     power_twi_disable();
-#ifndef TIMER_H
-    //power_timer0_disable(); // used in timer.c
-#endif
+    // timer0 is used in timer.c
     power_timer1_disable();
     power_timer2_disable();
 }
-*/
 
 /*
+ * Pull up unused pins given in config.h. Pulling up all ports was worse
+ * than nothing: current flows through USB D+/D-(zener diodes and pull-up
+ * resistor), matrix power switch and other circuits connected to the pins.
+ */
 static void pullup_pins(void)
 {
-    // DDRs are set to 0(input) by default.
-#ifdef PORTA
-    PORTA = 0xFF;
+#ifdef UNUSED_PINS_B
+    DDRB  &= ~(UNUSED_PINS_B);
+    PORTB |=  (UNUSED_PINS_B);
 #endif
-    PORTB = 0xFF;
-    PORTC = 0xFF;
-    PORTD = 0xFF;
-#ifdef PORTE
-    PORTE = 0xFF;
+#ifdef UNUSED_PINS_C
+    DDRC  &= ~(UNUSED_PINS_C);
+    PORTC |=  (UNUSED_PINS_C);
 #endif
-#ifdef PORTE
-    PORTF = 0xFF;
+#ifdef UNUSED_PINS_D
+    DDRD  &= ~(UNUSED_PINS_D);
+    PORTD |=  (UNUSED_PINS_D);
 #endif
 }
-*/
 
 
 #ifdef HOST_VUSB
@@ -121,15 +122,32 @@ static bool sleeping = false;
 static bool insomniac = false;   // TODO: should be false for power saving
 static uint16_t last_timer = 0;
 
+/*
+ * Latency of key press in sleep(ms): sleep period plus time from wake up
+ * to the report sent. timer stops in power-down, so the whole period is
+ * counted; a key pressed just after going to sleep waits that long.
+ * WDTO_60MS is 8K cycles of 128kHz watchdog oscillator. Bound is the
+ * period, a scan and the report sent on UART.
+ */
+#define SLEEP_MS                64
+#define WAKE_LATENCY_BOUND      (SLEEP_MS + 10)
+enum { WAKE_NONE, WAKE_SCAN, WAKE_REPORT };
+static uint8_t wake_state = WAKE_NONE;
+static uint16_t wake_timer = 0;
+static uint8_t wake_sent = 0;
+static uint8_t wake_latency = 0;
+static uint8_t wake_latency_max = 0;
+static uint8_t wake_late = 0;   // count of latencies over bound
+
 int main(void)
 {
     MCUSR = 0;
     clock_prescale_set(clock_div_1);
     WD_SET(WD_OFF);
 
-    // power saving: the result is worse than nothing... why?
-    //pullup_pins();
-    //set_prr();
+    // power saving
+    pullup_pins();
+    set_prr();
 
     print_enable = true;
     debug_enable = false;
@@ -167,10 +185,24 @@ int main(void)
             usbPoll();
 #endif
         keyboard_proc();
+        if (host_get_driver() == iwrap_driver())
+            iwrap_task();
 #ifdef HOST_VUSB
         if (host_get_driver() == vusb_driver())
             vusb_transfer_keyboard();
 #endif
+        // key press found by first scan after wake up is timed until its
+        // report is sent, which is later if connection is lost
+        if (wake_state == WAKE_SCAN)
+            wake_state = (matrix_is_modified() ? WAKE_REPORT : WAKE_NONE);
+        if (wake_state == WAKE_REPORT && iwrap_sent() != wake_sent) {
+            uint16_t t = SLEEP_MS + timer_elapsed(wake_timer);
+            wake_latency = (t > 0xFF) ? 0xFF : t;
+            if (wake_latency > wake_latency_max) wake_latency_max = wake_latency;
+            if (t > WAKE_LATENCY_BOUND && wake_late < 0xFF) wake_late++;
+            wake_state = WAKE_NONE;
+        }
+
         if (matrix_is_modified() || console()) {
             last_timer = timer_read();
             sleeping = false;
@@ -183,7 +215,13 @@ int main(void)
             if (sleeping && !insomniac) {
                 _delay_ms(1);   // wait for UART to send
                 iwrap_sleep();
+                // HHKB senses one key at a time through multiplexers, no
+                // pin changes by key press. It is scanned on watchdog wake up
+                // and key press is reported in WAKE_LATENCY_BOUND.
                 sleep(WDTO_60MS);
+                wake_state = WAKE_SCAN;
+                wake_timer = timer_read();
+                wake_sent = iwrap_sent();
             }
         }
     }
@@ -265,6 +303,7 @@ static uint8_t console_command(uint8_t c)
             print("u: USB mode. switch to USB.\n");
             print("w: BT mode. switch to Bluetooth.\n");
 #endif
+            print("l: wake up latency.\n");
             print("k: kill first connection.\n");
             print("Del: unpair first pairing.\n");
             print("\n");
@@ -304,6 +343,12 @@ static uint8_t console_command(uint8_t c)
             PCICR  |= 0b00000010;
             return 1;
 #endif
+        case 'l':
+            print("wake up latency(last/max ms): ");
+            phex(wake_latency); print("/"); phex(wake_latency_max); print("\n");
+            print("over bound of "); phex(WAKE_LATENCY_BOUND); print("ms: ");
+            phex(wake_late); print("\n");
+            return 1;
         case 'k':
             print("kill\n");
             iwrap_kill();
@@ -37,6 +37,9 @@
 #endif
 #include "host.h"
 #include "pjrc.h"
+#ifdef POWER_SAVE_ENABLE
+#   include "power.h"
+#endif
 
 
 #define CPU_PRESCALE(n)    (CLKPR = 0x80, CLKPR = (n))
@@ -97,6 +100,9 @@ int main(void)
 
     host_set_driver(pjrc_driver());
     while (1) {
-       keyboard_proc(); 
+        keyboard_proc();
+#ifdef POWER_SAVE_ENABLE
+        power_idle();
+#endif
     }
 }
@@ -26,13 +26,16 @@
 #include <avr/io.h>
 #include <avr/pgmspace.h>
 #include <avr/interrupt.h>
+#include <util/delay.h>
 #include "usb.h"
 #include "usb_keyboard.h"
 #include "usb_mouse.h"
 #include "usb_debug.h"
 #include "usb_extra.h"
+#include "host.h"
 #include "print.h"
 #include "util.h"
+#include "idle_rate.h"
 
 
 /**************************************************************************
@@ -91,6 +94,12 @@
 bool remote_wakeup = false;
 bool suspend = false;
 
+// bInterval of report endpoints, patched into config descriptor when sent
+uint8_t usb_polling_interval = USB_POLLING_INTERVAL;
+
+// frame counter, incremented at every start of frame
+volatile uint16_t usb_sof_count = 0;
+
 // 0:control endpoint is enabled automatically by controller.
 static const uint8_t PROGMEM endpoint_config_table[] = {
 	// enable, UECFG0X(type, direction), UECFG1X(size, bank, allocation)
@@ -222,6 +231,7 @@ static const uint8_t PROGMEM keyboard2_hid_report_desc[] = {
 // http://www.microchip.com/forums/tm.aspx?high=&m=391435&mpage=1#391521
 // http://www.keil.com/forum/15671/
 // http://www.microsoft.com/whdc/device/input/wheel.mspx
+// Resolution Multiplier lets host take wheel in 1/HOST_WHEEL_MULTIPLIER notch
 static const uint8_t PROGMEM mouse_hid_report_desc[] = {
     /* mouse */
     0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)
@@ -252,22 +262,40 @@ static const uint8_t PROGMEM mouse_hid_report_desc[] = {
     0x95, 0x02,                    //     REPORT_COUNT (2)
     0x81, 0x06,                    //     INPUT (Data,Var,Rel)
                                    // ----------------------------  Vertical wheel
-    0x09, 0x38,                    //     USAGE (Wheel)
-    0x15, 0x81,                    //     LOGICAL_MINIMUM (-127)
-    0x25, 0x7f,                    //     LOGICAL_MAXIMUM (127)
-    0x35, 0x00,                    //     PHYSICAL_MINIMUM (0)        - reset physical
-    0x45, 0x00,                    //     PHYSICAL_MAXIMUM (0)
-    0x75, 0x08,                    //     REPORT_SIZE (8)
-    0x95, 0x01,                    //     REPORT_COUNT (1)
-    0x81, 0x06,                    //     INPUT (Data,Var,Rel)
+    0xa1, 0x02,                    //     COLLECTION (Logical)
+    0x09, 0x48,                    //       USAGE (Resolution Multiplier)
+    0x15, 0x00,                    //       LOGICAL_MINIMUM (0)
+    0x25, 0x01,                    //       LOGICAL_MAXIMUM (1)
+    0x35, 0x01,                    //       PHYSICAL_MINIMUM (1)
+    0x45, HOST_WHEEL_MULTIPLIER,   //       PHYSICAL_MAXIMUM (8)
+    0x75, 0x02,                    //       REPORT_SIZE (2)
+    0x95, 0x01,                    //       REPORT_COUNT (1)
+    0xa4,                          //       PUSH
+    0xb1, 0x02,                    //       FEATURE (Data,Var,Abs)
+    0x09, 0x38,                    //       USAGE (Wheel)
+    0x15, 0x81,                    //       LOGICAL_MINIMUM (-127)
+    0x25, 0x7f,                    //       LOGICAL_MAXIMUM (127)
+    0x35, 0x00,                    //       PHYSICAL_MINIMUM (0)        - reset physical
+    0x45, 0x00,                    //       PHYSICAL_MAXIMUM (0)
+    0x75, 0x08,                    //       REPORT_SIZE (8)
+    0x81, 0x06,                    //       INPUT (Data,Var,Rel)
+    0xc0,                          //     END_COLLECTION
                                    // ----------------------------  Horizontal wheel
-    0x05, 0x0c,                    //     USAGE_PAGE (Consumer Devices)
-    0x0a, 0x38, 0x02,              //     USAGE (AC Pan)
-    0x15, 0x81,                    //     LOGICAL_MINIMUM (-127)
-    0x25, 0x7f,                    //     LOGICAL_MAXIMUM (127)
-    0x75, 0x08,                    //     REPORT_SIZE (8)
-    0x95, 0x01,                    //     REPORT_COUNT (1)
-    0x81, 0x06,                    //     INPUT (Data,Var,Rel)
+    0xa1, 0x02,                    //     COLLECTION (Logical)
+    0x09, 0x48,                    //       USAGE (Resolution Multiplier)
+    0xb4,                          //       POP
+    0xb1, 0x02,                    //       FEATURE (Data,Var,Abs)
+    0x35, 0x00,                    //       PHYSICAL_MINIMUM (0)        - reset physical
+    0x45, 0x00,                    //       PHYSICAL_MAXIMUM (0)
+    0x75, 0x04,                    //       REPORT_SIZE (4)
+    0xb1, 0x03,                    //       FEATURE (Cnst,Var,Abs)      - padding
+    0x05, 0x0c,                    //       USAGE_PAGE (Consumer Devices)
+    0x0a, 0x38, 0x02,              //       USAGE (AC Pan)
+    0x15, 0x81,                    //       LOGICAL_MINIMUM (-127)
+    0x25, 0x7f,                    //       LOGICAL_MAXIMUM (127)
+    0x75, 0x08,                    //       REPORT_SIZE (8)
+    0x81, 0x06,                    //       INPUT (Data,Var,Rel)
+    0xc0,                          //     END_COLLECTION
     0xc0,                          //   END_COLLECTION
     0xc0,                          // END_COLLECTION
 };
@@ -385,7 +413,7 @@ static const uint8_t PROGMEM config1_descriptor[CONFIG1_DESC_SIZE] = {
 	KBD_ENDPOINT | 0x80,			// bEndpointAddress
 	0x03,					// bmAttributes (0x03=intr)
 	KBD_SIZE, 0,				// wMaxPacketSize
-	10,					// bInterval
+	USB_POLLING_INTERVAL,		// bInterval
 
 #ifdef MOUSE_ENABLE
 	// interface descriptor, USB spec 9.6.5, page 267-269, Table 9-12
@@ -418,7 +446,7 @@ static const uint8_t PROGMEM config1_descriptor[CONFIG1_DESC_SIZE] = {
 	MOUSE_ENDPOINT | 0x80,			// bEndpointAddress
 	0x03,					// bmAttributes (0x03=intr)
 	MOUSE_SIZE, 0,				// wMaxPacketSize
-	1,					// bInterval
+	USB_POLLING_INTERVAL,		// bInterval
 #endif
 
 	// interface descriptor, USB spec 9.6.5, page 267-269, Table 9-12
@@ -474,7 +502,7 @@ static const uint8_t PROGMEM config1_descriptor[CONFIG1_DESC_SIZE] = {
 	EXTRA_ENDPOINT | 0x80,			// bEndpointAddress
 	0x03,					// bmAttributes (0x03=intr)
 	EXTRA_SIZE, 0,				// wMaxPacketSize
-	10,					// bInterval
+	USB_POLLING_INTERVAL,		// bInterval
 #endif
 
 #ifdef NKRO_ENABLE
@@ -503,7 +531,7 @@ static const uint8_t PROGMEM config1_descriptor[CONFIG1_DESC_SIZE] = {
 	KBD2_ENDPOINT | 0x80,			// bEndpointAddress
 	0x03,					// bmAttributes (0x03=intr)
 	KBD2_SIZE, 0,				// wMaxPacketSize
-	1,					// bInterval
+	USB_POLLING_INTERVAL,		// bInterval
 #endif
 };
 
@@ -611,6 +639,17 @@ void usb_remote_wakeup(void)
     UDCON |= (1<<RMWKUP);
 }
 
+// change polling interval of report endpoints. host reads bInterval
+// only on enumeration, so detach and attach again to apply it.
+void usb_set_polling_interval(uint8_t ms)
+{
+	if (ms == usb_polling_interval) return;
+	usb_polling_interval = ms;
+	UDCON |= (1<<DETACH);
+	_delay_ms(100);
+	UDCON &= ~(1<<DETACH);
+}
+
 
 
 /**************************************************************************
@@ -621,13 +660,28 @@ void usb_remote_wakeup(void)
 
 
 
+// Transmit scheduler - reports are queued by the user-callable send
+// functions and written here on every start of frame, in order of
+// priority: keyboard, consumer/system, mouse and then debug.  The
+// main loop never waits for an endpoint.
+static inline void usb_tx_service(void)
+{
+	usb_keyboard_transmit();
+#ifdef EXTRAKEY_ENABLE
+	usb_extra_transmit();
+#endif
+#ifdef MOUSE_ENABLE
+	usb_mouse_transmit();
+#endif
+	usb_debug_transmit();
+}
+
 // USB Device Interrupt - handle all device-level events
 // the transmit buffer flushing is triggered by the start of frame
 //
 ISR(USB_GEN_vect)
 {
-	uint8_t intbits, t;
-	static uint8_t div4=0;
+	uint8_t intbits, idle;
 
         intbits = UDINT;
         UDINT = 0;
@@ -643,48 +697,47 @@ ISR(USB_GEN_vect)
 		UECFG1X = EP_SIZE(ENDPOINT0_SIZE) | EP_SINGLE_BUFFER;
 		UEIENX = (1<<RXSTPE);
 		usb_configuration = 0;
+		idle_rate_init();
         }
 	if ((intbits & (1<<SOFI)) && usb_configuration) {
-		t = debug_flush_timer;
-		if (t) {
-			debug_flush_timer = -- t;
-			if (!t) {
-				UENUM = DEBUG_TX_ENDPOINT;
-				while ((UEINTX & (1<<RWAL))) {
-					UEDATX = 0;
-				}
-				UEINTX = 0x3A;
-			}
+		usb_sof_count++;
+		usb_tx_service();
+		idle = idle_rate_tick(1);
+		if (idle & (1<<IDLE_RATE_KEYBOARD)) {
+			usb_keyboard_send_idle();
+		}
+#ifdef MOUSE_ENABLE
+		if (idle & (1<<REPORT_ID_MOUSE)) {
+			usb_mouse_send_idle();
 		}
-                /* TODO: should keep IDLE rate on each keyboard interface */
-#ifdef NKRO_ENABLE
-		if (!keyboard_nkro && usb_keyboard_idle_config && (++div4 & 3) == 0) {
-#else
-		if (usb_keyboard_idle_config && (++div4 & 3) == 0) {
 #endif
-			UENUM = KBD_ENDPOINT;
-			if (UEINTX & (1<<RWAL)) {
-				usb_keyboard_idle_count++;
-				if (usb_keyboard_idle_count == usb_keyboard_idle_config) {
-					usb_keyboard_idle_count = 0;
-                                        /* TODO: fix keyboard_report inconsistency */
-/* To avoid Mac SET_IDLE behaviour.
-					UEDATX = keyboard_report_prev->mods;
-					UEDATX = 0;
-                                        uint8_t keys = usb_keyboard_protocol ? KBD_REPORT_KEYS : 6;
-					for (uint8_t i=0; i<keys; i++) {
-						UEDATX = keyboard_report_prev->keys[i];
-					}
-					UEINTX = 0x3A;
-*/
-				}
-			}
+#ifdef EXTRAKEY_ENABLE
+		if (idle & (1<<REPORT_ID_SYSTEM)) {
+			usb_extra_send_idle(REPORT_ID_SYSTEM);
 		}
+		if (idle & (1<<REPORT_ID_CONSUMER)) {
+			usb_extra_send_idle(REPORT_ID_CONSUMER);
+		}
+#endif
 	}
 }
 
 
 
+// read a byte of descriptor, with bInterval of report endpoints in
+// config descriptor replaced by usb_polling_interval. debug endpoint
+// keeps its own interval.
+static inline uint8_t descriptor_byte(const uint8_t *addr)
+{
+	uint16_t offset = addr - config1_descriptor;
+	if (offset >= 9 && offset < CONFIG1_DESC_SIZE &&
+	    (offset - 9) % (9+9+7) == (9+9+7) - 1 &&
+	    (offset - 9) / (9+9+7) != DEBUG_HID_DESC_NUM) {
+		return usb_polling_interval;
+	}
+	return pgm_read_byte(addr);
+}
+
 // Misc functions to wait for ready and send/receive packets
 static inline void usb_wait_in_ready(void)
 {
@@ -771,7 +824,7 @@ ISR(USB_COM_vect)
 				// send IN packet
 				n = len < ENDPOINT0_SIZE ? len : ENDPOINT0_SIZE;
 				for (i = n; i; i--) {
-					UEDATX = pgm_read_byte(desc_addr++);
+					UEDATX = descriptor_byte(desc_addr++);
 				}
 				len -= n;
 				usb_send_in();
@@ -786,6 +839,8 @@ ISR(USB_COM_vect)
 		}
 		if (bRequest == SET_CONFIGURATION && bmRequestType == 0) {
 			usb_configuration = wValue;
+			// Resolution Multiplier returns to default with configuration
+			host_wheel_hires = 0;
 			usb_send_in();
 			cfg = endpoint_config_table;
 			for (i=1; i<=MAX_ENDPOINT; i++) {
@@ -867,7 +922,7 @@ ISR(USB_COM_vect)
 				}
 				if (bRequest == HID_GET_IDLE) {
 					usb_wait_in_ready();
-					UEDATX = usb_keyboard_idle_config;
+					UEDATX = idle_rate_get(IDLE_RATE_KEYBOARD);
 					usb_send_in();
 					return;
 				}
@@ -887,8 +942,7 @@ ISR(USB_COM_vect)
 					return;
 				}
 				if (bRequest == HID_SET_IDLE) {
-					usb_keyboard_idle_config = (wValue >> 8);
-					usb_keyboard_idle_count = 0;
+					idle_rate_set(IDLE_RATE_KEYBOARD, (wValue >> 8));
 					//usb_wait_in_ready();
 					usb_send_in();
 					return;
@@ -914,9 +968,9 @@ ISR(USB_COM_vect)
 					usb_send_in();
 					return;
                                     }
-                                    if (wValue == HID_REPORT_FEATURE) {
+                                    if ((wValue >> 8) == HID_REPORT_FEATURE) {
 					usb_wait_in_ready();
-					UEDATX = 0x05;
+					UEDATX = host_wheel_hires;
 					usb_send_in();
 					return;
                                     }
@@ -927,13 +981,76 @@ ISR(USB_COM_vect)
 					usb_send_in();
 					return;
 				}
+				if (bRequest == HID_GET_IDLE) {
+					usb_wait_in_ready();
+					UEDATX = idle_rate_get(REPORT_ID_MOUSE);
+					usb_send_in();
+					return;
+				}
 			}
 			if (bmRequestType == 0x21) {
+				if (bRequest == HID_SET_REPORT && (wValue >> 8) == HID_REPORT_FEATURE) {
+					usb_wait_receive_out();
+					host_wheel_hires = UEDATX;
+					usb_ack_out();
+					usb_send_in();
+					return;
+				}
 				if (bRequest == HID_SET_PROTOCOL) {
 					usb_mouse_protocol = wValue;
 					usb_send_in();
 					return;
 				}
+				if (bRequest == HID_SET_IDLE) {
+					idle_rate_set(REPORT_ID_MOUSE, (wValue >> 8));
+					usb_send_in();
+					return;
+				}
+			}
+		}
+#endif
+#ifdef EXTRAKEY_ENABLE
+		if (wIndex == EXTRA_INTERFACE) {
+			// report ID in low byte of wValue, 0 applies to all reports
+			if (bmRequestType == 0xA1) {
+				if (bRequest == HID_GET_IDLE) {
+					usb_wait_in_ready();
+					UEDATX = idle_rate_get((wValue & 0xFF) ? (wValue & 0xFF) : REPORT_ID_SYSTEM);
+					usb_send_in();
+					return;
+				}
+			}
+			if (bmRequestType == 0x21) {
+				if (bRequest == HID_SET_IDLE) {
+					if ((wValue & 0xFF) == 0) {
+						idle_rate_set(REPORT_ID_SYSTEM, (wValue >> 8));
+						idle_rate_set(REPORT_ID_CONSUMER, (wValue >> 8));
+					} else {
+						idle_rate_set((wValue & 0xFF), (wValue >> 8));
+					}
+					usb_send_in();
+					return;
+				}
+			}
+		}
+#endif
+#ifdef NKRO_ENABLE
+		if (wIndex == KBD2_INTERFACE) {
+			// shares idle rate with boot keyboard, only one of them is in use
+			if (bmRequestType == 0xA1) {
+				if (bRequest == HID_GET_IDLE) {
+					usb_wait_in_ready();
+					UEDATX = idle_rate_get(IDLE_RATE_KEYBOARD);
+					usb_send_in();
+					return;
+				}
+			}
+			if (bmRequestType == 0x21) {
+				if (bRequest == HID_SET_IDLE) {
+					idle_rate_set(IDLE_RATE_KEYBOARD, (wValue >> 8));
+					usb_send_in();
+					return;
+				}
 			}
 		}
 #endif
@@ -29,12 +29,20 @@
 #include <avr/io.h>
 
 
+// polling interval of report endpoints in ms: 1, 2, 4, 8 or 10
+#ifndef USB_POLLING_INTERVAL
+#   define USB_POLLING_INTERVAL 1
+#endif
+
 extern bool remote_wakeup;
 extern bool suspend;
+extern uint8_t usb_polling_interval;
+extern volatile uint16_t usb_sof_count;
 
 void usb_init(void);			// initialize everything
 uint8_t usb_configured(void);		// is the USB port configured
 void usb_remote_wakeup(void);
+void usb_set_polling_interval(uint8_t ms);	// re-enumerates with new interval
 
 
 #define EP_TYPE_CONTROL			0x00
@@ -26,15 +26,44 @@
 #include "usb_debug.h"
 
 
+// output is buffered in RAM and written to the endpoint from the
+// start of frame interrupt, so print never waits for the host.
+#ifndef DEBUG_BUFFER_SIZE
+#   define DEBUG_BUFFER_SIZE	128
+#endif
+static uint8_t debug_buffer[DEBUG_BUFFER_SIZE];
+static uint8_t debug_head=0;
+static uint8_t debug_tail=0;
+
 // the time remaining before we transmit any partially full
 // packet, or send a zero length packet.
 volatile uint8_t debug_flush_timer=0;
 
+// count of characters dropped because buffer was full
+volatile uint16_t usb_debug_overflow=0;
+
+
+static inline uint8_t buffered(void)
+{
+	return (debug_head + DEBUG_BUFFER_SIZE - debug_tail) % DEBUG_BUFFER_SIZE;
+}
+
+static inline void write_packet(uint8_t n)
+{
+	while (n--) {
+		UEDATX = debug_buffer[debug_tail];
+		debug_tail = (debug_tail + 1) % DEBUG_BUFFER_SIZE;
+	}
+	while ((UEINTX & (1<<RWAL))) {
+		UEDATX = 0;
+	}
+	UEINTX = 0x3A;
+}
+
 
 int8_t sendchar(uint8_t c)
 {
-	static uint8_t previous_timeout=0;
-	uint8_t timeout, intr_state;
+	uint8_t next, intr_state;
 
 	// if we're not online (enumerated and configured), error
 	if (!usb_configured()) return -1;
@@ -43,60 +72,44 @@ int8_t sendchar(uint8_t c)
 	// even both in the same program!
 	intr_state = SREG;
 	cli();
-	UENUM = DEBUG_TX_ENDPOINT;
-	// if we gave up due to timeout before, don't wait again
-	if (previous_timeout) {
-		if (!(UEINTX & (1<<RWAL))) {
-			SREG = intr_state;
-			return -1;
-		}
-		previous_timeout = 0;
-	}
-	// wait for the FIFO to be ready to accept data
-	timeout = UDFNUML + 4;
-	while (1) {
-		// are we ready to transmit?
-		if (UEINTX & (1<<RWAL)) break;
+	next = (debug_head + 1) % DEBUG_BUFFER_SIZE;
+	if (next == debug_tail) {
+		// drop rather than stall
+		if (usb_debug_overflow < 0xFFFF) usb_debug_overflow++;
 		SREG = intr_state;
-		// have we waited too long?
-		if (UDFNUML == timeout) {
-			previous_timeout = 1;
-			return -1;
-		}
-		// has the USB gone offline?
-		if (!usb_configured()) return -1;
-		// get ready to try checking again
-		intr_state = SREG;
-		cli();
-		UENUM = DEBUG_TX_ENDPOINT;
-	}
-	// actually write the byte into the FIFO
-	UEDATX = c;
-	// if this completed a packet, transmit it now!
-	if (!(UEINTX & (1<<RWAL))) {
-		UEINTX = 0x3A;
-		debug_flush_timer = 0;
-	} else {
-		debug_flush_timer = 2;
+		return -1;
 	}
+	debug_buffer[debug_head] = c;
+	debug_head = next;
+	debug_flush_timer = 2;
 	SREG = intr_state;
 	return 0;
 }
 
-// immediately transmit any buffered output.
+// called from start of frame interrupt. full packets are written
+// while the endpoint has room, a partial one only after output
+// has stopped for a couple of frames.
+void usb_debug_transmit(void)
+{
+	UENUM = DEBUG_TX_ENDPOINT;
+	while (buffered() >= DEBUG_TX_SIZE) {
+		if (!(UEINTX & (1<<RWAL))) return;
+		write_packet(DEBUG_TX_SIZE);
+	}
+	if (!buffered()) return;
+	if (debug_flush_timer && --debug_flush_timer) return;
+	if (!(UEINTX & (1<<RWAL))) return;
+	write_packet(buffered());
+}
+
+// immediately transmit as much buffered output as the endpoint takes.
 void usb_debug_flush_output(void)
 {
 	uint8_t intr_state;
 
 	intr_state = SREG;
 	cli();
-	if (debug_flush_timer) {
-		UENUM = DEBUG_TX_ENDPOINT;
-		while ((UEINTX & (1<<RWAL))) {
-			UEDATX = 0;
-		}
-		UEINTX = 0x3A;
-		debug_flush_timer = 0;
-	}
+	debug_flush_timer = 0;
+	usb_debug_transmit();
 	SREG = intr_state;
 }
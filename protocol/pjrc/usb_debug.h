@@ -35,8 +35,10 @@
 
 
 extern volatile uint8_t debug_flush_timer;
+extern volatile uint16_t usb_debug_overflow;
 
 
+void usb_debug_transmit(void);		// write buffered output, from SOF interrupt
 void usb_debug_flush_output(void);	// immediately transmit any buffered output
 
 #endif
@@ -25,38 +25,130 @@
 #include <avr/interrupt.h>
 #include "host.h"
 #include "usb_extra.h"
+#include "idle_rate.h"
 
 
+// count of reports overwritten because queue was full and no pending report
+// could be removed without losing a change
+uint8_t usb_extra_overflow=0;
+
+// reports waiting for endpoint, written by usb_extra_transmit()
+#define EXTRA_QUEUE_SIZE 4
+static struct {
+	uint8_t report_id;
+	uint16_t data;
+} queue[EXTRA_QUEUE_SIZE];
+static uint8_t queue_head=0;
+static uint8_t queue_tail=0;
+
+// last data of system(index 0) and consumer(index 1) reports for idle
+static uint16_t last_data[2];
+
+static inline void write_report(uint8_t report_id, uint16_t data);
+
+// report holds one usage. report r between reports a and b of its ID is
+// redundant when host sees the same press and release without it: r is same
+// as a or b, or r releases a usage which b doesn't hold again.
+static inline bool is_redundant(uint16_t a, uint16_t r, uint16_t b)
+{
+	return (r == a || r == b || (r == 0 && a != b));
+}
+
+// remove oldest redundant pending report, report_id and data are of the
+// report to be queued next. interrupts must be disabled.
+static bool drop_redundant(uint8_t report_id, uint16_t data)
+{
+	uint8_t i, n, id;
+	uint16_t prev[2] = { last_data[0], last_data[1] };
+
+	for (i = queue_tail; i != queue_head; i = (i + 1) % EXTRA_QUEUE_SIZE) {
+		id = queue[i].report_id - REPORT_ID_SYSTEM;
+		for (n = (i + 1) % EXTRA_QUEUE_SIZE; n != queue_head; n = (n + 1) % EXTRA_QUEUE_SIZE) {
+			if (queue[n].report_id == queue[i].report_id) break;
+		}
+		if (n != queue_head) {
+			if (is_redundant(prev[id], queue[i].data, queue[n].data)) break;
+		} else if (report_id == queue[i].report_id) {
+			if (is_redundant(prev[id], queue[i].data, data)) break;
+		} else {
+			// last state of its ID
+			if (queue[i].data == prev[id]) break;
+		}
+		prev[id] = queue[i].data;
+	}
+	if (i == queue_head) return false;
+
+	for (n = (i + 1) % EXTRA_QUEUE_SIZE; n != queue_head; i = n, n = (n + 1) % EXTRA_QUEUE_SIZE) {
+		queue[i] = queue[n];
+	}
+	queue_head = i;
+	return true;
+}
+
 int8_t usb_extra_send(uint8_t report_id, uint16_t data)
 {
-	uint8_t intr_state, timeout;
+	uint8_t intr_state, next, i;
 
 	if (!usb_configured()) return -1;
 	intr_state = SREG;
 	cli();
+	next = (queue_head + 1) % EXTRA_QUEUE_SIZE;
+	// full: a redundant pending report is removed so that a key press is
+	// not lost. if every pending report changes, newest one of the same ID
+	// is overwritten, or newest one when there is none.
+	if (next == queue_tail && !drop_redundant(report_id, data)) {
+		i = queue_head;
+		do {
+			i = (i + EXTRA_QUEUE_SIZE - 1) % EXTRA_QUEUE_SIZE;
+		} while (queue[i].report_id != report_id && i != queue_tail);
+		if (queue[i].report_id != report_id)
+			i = (queue_head + EXTRA_QUEUE_SIZE - 1) % EXTRA_QUEUE_SIZE;
+		queue[i].data = data;
+		queue[i].report_id = report_id;
+		if (usb_extra_overflow < 0xFF) usb_extra_overflow++;
+	} else {
+		queue[queue_head].report_id = report_id;
+		queue[queue_head].data = data;
+		queue_head = (queue_head + 1) % EXTRA_QUEUE_SIZE;
+	}
+	// send right now if endpoint has room, otherwise on next SOF
+	usb_extra_transmit();
+	SREG = intr_state;
+	return 0;
+}
+
+// write queued reports while endpoint has room. interrupts must be disabled.
+void usb_extra_transmit(void)
+{
+	uint8_t report_id;
+
 	UENUM = EXTRA_ENDPOINT;
-	timeout = UDFNUML + 50;
-	while (1) {
-		// are we ready to transmit?
-		if (UEINTX & (1<<RWAL)) break;
-		SREG = intr_state;
-		// has the USB gone offline?
-		if (!usb_configured()) return -1;
-		// have we waited too long?
-		if (UDFNUML == timeout) return -1;
-		// get ready to try checking again
-		intr_state = SREG;
-		cli();
-		UENUM = EXTRA_ENDPOINT;
+	while (queue_tail != queue_head) {
+		if (!(UEINTX & (1<<RWAL))) return;
+		report_id = queue[queue_tail].report_id;
+		write_report(report_id, queue[queue_tail].data);
+		last_data[report_id - REPORT_ID_SYSTEM] = queue[queue_tail].data;
+		idle_rate_restart(report_id);
+		queue_tail = (queue_tail + 1) % EXTRA_QUEUE_SIZE;
 	}
+}
 
+// called from SOF interrupt when idle duration elapses
+void usb_extra_send_idle(uint8_t report_id)
+{
+	if (queue_tail != queue_head) return;
+	UENUM = EXTRA_ENDPOINT;
+	if (!(UEINTX & (1<<RWAL))) return;
+	write_report(report_id, last_data[report_id - REPORT_ID_SYSTEM]);
+}
+
+static inline void write_report(uint8_t report_id, uint16_t data)
+{
 	UEDATX = report_id;
         UEDATX = data&0xFF;
         UEDATX = (data>>8)&0xFF;
 
 	UEINTX = 0x3A;
-	SREG = intr_state;
-	return 0;
 }
 
 int8_t usb_extra_consumer_send(uint16_t bits)
@@ -40,7 +40,12 @@
 #define EXTRA_BUFFER		EP_DOUBLE_BUFFER
 
 
+extern uint8_t usb_extra_overflow;
+
+
 int8_t usb_extra_consumer_send(uint16_t bits);
 int8_t usb_extra_system_send(uint16_t bits);
+void usb_extra_transmit(void);
+void usb_extra_send_idle(uint8_t report_id);
 
 #endif
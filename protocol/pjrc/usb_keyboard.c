@@ -30,6 +30,7 @@
 #include "debug.h"
 #include "util.h"
 #include "host.h"
+#include "idle_rate.h"
 
 
 // protocol setting from the host.  We use exactly the same report
@@ -37,43 +38,162 @@
 // are required to be able to report which setting is in use.
 uint8_t usb_keyboard_protocol=1;
 
-// the idle configuration, how often we send the report to the
-// host (ms * 4) even when it hasn't changed
-// Windows and Linux set 0 while OS X sets 6(24ms) by SET_IDLE request.
-uint8_t usb_keyboard_idle_config=125;
-
-// count until idle timeout
-uint8_t usb_keyboard_idle_count=0;
-
 // 1=num lock, 2=caps lock, 4=scroll lock, 8=compose, 16=kana
 volatile uint8_t usb_keyboard_leds=0;
 
+// count of reports overwritten because queue was full and no pending report
+// could be removed without losing a key change
+uint8_t usb_keyboard_overflow=0;
+
+// frames between last two reports taken back to back by host, that is
+// the polling interval actually achieved
+uint8_t usb_keyboard_interval=0;
+static uint16_t last_write_sof=0;
+static bool write_blocked=false;
+
+// reports waiting for endpoint, written by usb_keyboard_transmit()
+#define KBD_QUEUE_SIZE 4
+static report_keyboard_t queue[KBD_QUEUE_SIZE];
+static uint8_t queue_endpoint[KBD_QUEUE_SIZE];
+static uint8_t queue_head=0;
+static uint8_t queue_tail=0;
+
+// last report sent, repeated when idle duration elapses
+static report_keyboard_t last_report;
+static uint8_t last_endpoint=KBD_ENDPOINT;
+
+
+static inline void write_report(report_keyboard_t *report, uint8_t endpoint);
+
+static bool has_key(report_keyboard_t *report, uint8_t code)
+{
+    for (uint8_t i = 0; i < REPORT_KEYS; i++) {
+        if (report->keys[i] == code) return true;
+    }
+    return false;
+}
+
+// report r between reports a and b is redundant when each key and modifier
+// of it is in the state of a or of b, that is host sees the same press and
+// release without it.
+static bool is_redundant(report_keyboard_t *a, report_keyboard_t *r, report_keyboard_t *b, bool bitmap)
+{
+    if ((r->mods ^ a->mods) & (r->mods ^ b->mods)) return false;
+    for (uint8_t i = 0; i < REPORT_KEYS; i++) {
+        if (bitmap) {
+            if ((r->keys[i] ^ a->keys[i]) & (r->keys[i] ^ b->keys[i])) return false;
+            continue;
+        }
+        // press only in r, or release only in r
+        if (r->keys[i] && !has_key(a, r->keys[i]) && !has_key(b, r->keys[i])) return false;
+        if (a->keys[i] && has_key(b, a->keys[i]) && !has_key(r, a->keys[i])) return false;
+    }
+    return true;
+}
+
+// remove oldest pending report made redundant by the reports around it,
+// 'in' is the report to be queued next. interrupts must be disabled.
+static bool drop_redundant(report_keyboard_t *in, uint8_t endpoint)
+{
+    uint8_t i, n;
+    report_keyboard_t *prev = &last_report;
+    uint8_t prev_endpoint = last_endpoint;
 
-static inline int8_t send_report(report_keyboard_t *report, uint8_t endpoint, uint8_t keys_start, uint8_t keys_end);
+    for (i = queue_tail; i != queue_head; i = n) {
+        n = (i + 1) % KBD_QUEUE_SIZE;
+        report_keyboard_t *next = (n == queue_head ? in : &queue[n]);
+        uint8_t next_endpoint = (n == queue_head ? endpoint : queue_endpoint[n]);
+        bool bitmap = false;
+#ifdef NKRO_ENABLE
+        bitmap = (queue_endpoint[i] == KBD2_ENDPOINT);
+#endif
+        if (prev_endpoint == queue_endpoint[i] && next_endpoint == queue_endpoint[i] &&
+                is_redundant(prev, &queue[i], next, bitmap)) {
+            break;
+        }
+        prev = &queue[i];
+        prev_endpoint = queue_endpoint[i];
+    }
+    if (i == queue_head) return false;
+
+    for (n = (i + 1) % KBD_QUEUE_SIZE; n != queue_head; i = n, n = (n + 1) % KBD_QUEUE_SIZE) {
+        queue[i] = queue[n];
+        queue_endpoint[i] = queue_endpoint[n];
+    }
+    queue_head = i;
+    return true;
+}
 
 
 int8_t usb_keyboard_send_report(report_keyboard_t *report)
 {
-    int8_t result = 0;
+    uint8_t intr_state, next;
+    uint8_t endpoint = KBD_ENDPOINT;
 
 #ifdef NKRO_ENABLE
     if (keyboard_nkro)
-        result = send_report(report, KBD2_ENDPOINT, 0, KBD2_REPORT_KEYS);
-    else
+        endpoint = KBD2_ENDPOINT;
 #endif
-    {
-        if (usb_keyboard_protocol)
-            result = send_report(report, KBD_ENDPOINT, 0, KBD_REPORT_KEYS);
-        else
-            result = send_report(report, KBD_ENDPOINT, 0, 6);
+    if (!usb_configured()) return -1;
+
+    intr_state = SREG;
+    cli();
+    next = (queue_head + 1) % KBD_QUEUE_SIZE;
+    // full: a redundant pending report is removed so that a tap is not lost.
+    // newest one is overwritten if every pending report has a key change.
+    if (next == queue_tail && drop_redundant(report, endpoint)) {
+        next = (queue_head + 1) % KBD_QUEUE_SIZE;
+    } else if (next == queue_tail) {
+        next = queue_head;
+        queue_head = (queue_head + KBD_QUEUE_SIZE - 1) % KBD_QUEUE_SIZE;
+        if (usb_keyboard_overflow < 0xFF) usb_keyboard_overflow++;
     }
+    queue[queue_head] = *report;
+    queue_endpoint[queue_head] = endpoint;
+    queue_head = next;
+    // send right now if endpoint has room, otherwise on next SOF
+    usb_keyboard_transmit();
+    SREG = intr_state;
 
-    if (result) return result;
-    usb_keyboard_idle_count = 0;
     usb_keyboard_print_report(report);
     return 0;
 }
 
+// write queued reports while endpoint has room. interrupts must be disabled.
+void usb_keyboard_transmit(void)
+{
+    while (queue_tail != queue_head) {
+        UENUM = queue_endpoint[queue_tail];
+        if (!(UEINTX & (1<<RWAL))) {
+            write_blocked = true;
+            return;
+        }
+        if (write_blocked) {
+            uint16_t frames = usb_sof_count - last_write_sof;
+            usb_keyboard_interval = (frames > 0xFF) ? 0xFF : frames;
+            write_blocked = false;
+        }
+        last_write_sof = usb_sof_count;
+        write_report(&queue[queue_tail], queue_endpoint[queue_tail]);
+        last_report = queue[queue_tail];
+        last_endpoint = queue_endpoint[queue_tail];
+        idle_rate_restart(IDLE_RATE_KEYBOARD);
+        queue_tail = (queue_tail + 1) % KBD_QUEUE_SIZE;
+    }
+}
+
+// called from SOF interrupt when idle duration elapses
+void usb_keyboard_send_idle(void)
+{
+    // pending report is newer than idle one
+    if (queue_tail != queue_head) return;
+
+    UENUM = last_endpoint;
+    // host has not taken previous report yet, repeating it is redundant
+    if (!(UEINTX & (1<<RWAL))) return;
+    write_report(&last_report, last_endpoint);
+}
+
 void usb_keyboard_print_report(report_keyboard_t *report)
 {
     if (!debug_keyboard) return;
@@ -82,41 +202,22 @@ void usb_keyboard_print_report(report_keyboard_t *report)
     print(" mods: "); phex(report->mods); print("\n");
 }
 
-extern volatile unsigned char report_sent;
-static inline int8_t send_report(report_keyboard_t *report, uint8_t endpoint, uint8_t keys_start, uint8_t keys_end)
+// write report into selected endpoint. interrupts must be disabled.
+static inline void write_report(report_keyboard_t *report, uint8_t endpoint)
 {
-    uint8_t intr_state, timeout;
+    uint8_t keys_end = usb_keyboard_protocol ? KBD_REPORT_KEYS : 6;
 
-    if (!usb_configured()) return -1;
-    intr_state = SREG;
-    cli();
-    UENUM = endpoint;
-    timeout = UDFNUML + 50;
-    while (1) {
-            // are we ready to transmit?
-            if (UEINTX & (1<<RWAL)) break;
-            SREG = intr_state;
-            // has the USB gone offline?
-            if (!usb_configured()) return -1;
-            // have we waited too long?
-            if (UDFNUML == timeout) return -1;
-            // get ready to try checking again
-            intr_state = SREG;
-            cli();
-            UENUM = endpoint;
-    }
     UEDATX = report->mods;
 #ifdef NKRO_ENABLE
-    if (!keyboard_nkro)
+    if (endpoint == KBD2_ENDPOINT)
+        keys_end = KBD2_REPORT_KEYS;
+    else
         UEDATX = 0;
 #else
     UEDATX = 0;
 #endif
-    for (uint8_t i = keys_start; i < keys_end; i++) {
+    for (uint8_t i = 0; i < keys_end; i++) {
             UEDATX = report->keys[i];
     }
     UEINTX = 0x3A;
-    SREG = intr_state;
-    report_sent = 1;
-    return 0;
 }
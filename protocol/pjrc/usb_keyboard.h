@@ -31,12 +31,14 @@
 
 
 extern uint8_t usb_keyboard_protocol;
-extern uint8_t usb_keyboard_idle_config;
-extern uint8_t usb_keyboard_idle_count;
 extern volatile uint8_t usb_keyboard_leds;
+extern uint8_t usb_keyboard_overflow;
+extern uint8_t usb_keyboard_interval;
 
 
 int8_t usb_keyboard_send_report(report_keyboard_t *report);
 void usb_keyboard_print_report(report_keyboard_t *report);
+void usb_keyboard_transmit(void);
+void usb_keyboard_send_idle(void);
 
 #endif
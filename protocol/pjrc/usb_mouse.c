@@ -26,37 +26,123 @@
 #include "usb_mouse.h"
 #include "print.h"
 #include "debug.h"
+#include "idle_rate.h"
 
 
 uint8_t usb_mouse_protocol=1;
 
+// count of reports merged into pending one because queue was full
+uint8_t usb_mouse_overflow=0;
+
+// reports waiting for endpoint, written by usb_mouse_transmit()
+#define MOUSE_QUEUE_SIZE 4
+static report_mouse_t queue[MOUSE_QUEUE_SIZE];
+static uint8_t queue_head=0;
+static uint8_t queue_tail=0;
+
+// buttons of last report, repeated without movement on idle
+static uint8_t last_buttons=0;
+
+
+static inline void write_report(uint8_t buttons, int8_t x, int8_t y, int8_t wheel_v, int8_t wheel_h);
+
+static inline int8_t add_clamp(int8_t a, int8_t b)
+{
+	int16_t n = (int16_t)a + b;
+	return (n > 127 ? 127 : (n < -127 ? -127 : n));
+}
+
+static inline void merge(report_mouse_t *to, report_mouse_t *from)
+{
+	to->x = add_clamp(to->x, from->x);
+	to->y = add_clamp(to->y, from->y);
+	to->v = add_clamp(to->v, from->v);
+	to->h = add_clamp(to->h, from->h);
+}
+
+// remove oldest pending report which doesn't change buttons, its movement
+// goes to the report after it. interrupts must be disabled.
+static bool drop_movement(report_mouse_t *in)
+{
+	uint8_t i, n, prev = last_buttons;
+
+	for (i = queue_tail; i != queue_head; i = (i + 1) % MOUSE_QUEUE_SIZE) {
+		if (queue[i].buttons == prev) break;
+		prev = queue[i].buttons;
+	}
+	if (i == queue_head) return false;
+
+	n = (i + 1) % MOUSE_QUEUE_SIZE;
+	merge((n == queue_head ? in : &queue[n]), &queue[i]);
+	for (; n != queue_head; i = n, n = (n + 1) % MOUSE_QUEUE_SIZE) {
+		queue[i] = queue[n];
+	}
+	queue_head = i;
+	return true;
+}
+
 
 int8_t usb_mouse_send(int8_t x, int8_t y, int8_t wheel_v, int8_t wheel_h, uint8_t buttons)
 {
-	uint8_t intr_state, timeout;
+	uint8_t intr_state;
+	bool full;
+	report_mouse_t *r;
+	report_mouse_t in = { .buttons = buttons, .x = x, .y = y, .v = wheel_v, .h = wheel_h };
 
 	if (!usb_configured()) return -1;
-	if (x == -128) x = -127;
-	if (y == -128) y = -127;
-	if (wheel_v == -128) wheel_v = -127;
-	if (wheel_h == -128) wheel_h = -127;
+	if (in.x == -128) in.x = -127;
+	if (in.y == -128) in.y = -127;
+	if (in.v == -128) in.v = -127;
+	if (in.h == -128) in.h = -127;
 	intr_state = SREG;
 	cli();
+	full = ((queue_head + 1) % MOUSE_QUEUE_SIZE == queue_tail);
+	if (full && usb_mouse_overflow < 0xFF) usb_mouse_overflow++;
+	// full: movement is merged into newest pending report with same
+	// buttons, or a movement only report is dropped so that a click is not
+	// lost. newest one is overwritten if all pending reports change buttons.
+	r = &queue[(queue_head + MOUSE_QUEUE_SIZE - 1) % MOUSE_QUEUE_SIZE];
+	if (full && (r->buttons == buttons || !drop_movement(&in))) {
+		merge(r, &in);
+		r->buttons = buttons;
+	} else {
+		queue[queue_head] = in;
+		queue_head = (queue_head + 1) % MOUSE_QUEUE_SIZE;
+	}
+	// send right now if endpoint has room, otherwise on next SOF
+	usb_mouse_transmit();
+	SREG = intr_state;
+	return 0;
+}
+
+// write queued reports while endpoint has room. interrupts must be disabled.
+void usb_mouse_transmit(void)
+{
+	report_mouse_t *r;
+
 	UENUM = MOUSE_ENDPOINT;
-	timeout = UDFNUML + 50;
-	while (1) {
-		// are we ready to transmit?
-		if (UEINTX & (1<<RWAL)) break;
-		SREG = intr_state;
-		// has the USB gone offline?
-		if (!usb_configured()) return -1;
-		// have we waited too long?
-		if (UDFNUML == timeout) return -1;
-		// get ready to try checking again
-		intr_state = SREG;
-		cli();
-		UENUM = MOUSE_ENDPOINT;
+	while (queue_tail != queue_head) {
+		if (!(UEINTX & (1<<RWAL))) return;
+		r = &queue[queue_tail];
+		write_report(r->buttons, r->x, r->y, r->v, r->h);
+		last_buttons = r->buttons;
+		idle_rate_restart(REPORT_ID_MOUSE);
+		queue_tail = (queue_tail + 1) % MOUSE_QUEUE_SIZE;
 	}
+}
+
+// called from SOF interrupt when idle duration elapses
+void usb_mouse_send_idle(void)
+{
+	if (queue_tail != queue_head) return;
+	UENUM = MOUSE_ENDPOINT;
+	if (!(UEINTX & (1<<RWAL))) return;
+	// movement is relative and must not be repeated
+	write_report(last_buttons, 0, 0, 0, 0);
+}
+
+static inline void write_report(uint8_t buttons, int8_t x, int8_t y, int8_t wheel_v, int8_t wheel_h)
+{
 	UEDATX = buttons;
 	UEDATX = x;
 	UEDATX = y;
@@ -64,10 +150,7 @@ int8_t usb_mouse_send(int8_t x, int8_t y, int8_t wheel_v, int8_t wheel_h, uint8_
             UEDATX = wheel_v;
             UEDATX = wheel_h;
         }
-        
 	UEINTX = 0x3A;
-	SREG = intr_state;
-	return 0;
 }
 
 void usb_mouse_print(int8_t x, int8_t y, int8_t wheel_v, int8_t wheel_h, uint8_t buttons) {
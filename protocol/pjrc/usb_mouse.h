@@ -42,9 +42,12 @@
 
 
 extern uint8_t usb_mouse_protocol;
+extern uint8_t usb_mouse_overflow;
 
 
 int8_t usb_mouse_send(int8_t x, int8_t y, int8_t wheel_v, int8_t wheel_h, uint8_t buttons);
+void usb_mouse_transmit(void);
+void usb_mouse_send_idle(void);
 void usb_mouse_print(int8_t x, int8_t y, int8_t wheel_v, int8_t wheel_h, uint8_t buttons);
 
 #endif
@@ -320,6 +320,28 @@ void ps2_host_set_led(uint8_t led)
     ps2_host_send(led);
 }
 
+/* No buffer for responses here, so command waits for its response and
+ * ps2_host_poll_response() returns it later. */
+static uint8_t async_response = 0;
+
+bool ps2_host_send_async(uint8_t data)
+{
+    async_response = ps2_host_send(data);
+    return async_response;
+}
+
+uint8_t ps2_host_poll_response(void)
+{
+    uint8_t res = async_response;
+    async_response = 0;
+    return res;
+}
+
+void ps2_host_cancel_response(void)
+{
+    async_response = 0;
+}
+
 
 /* called after start bit comes */
 static uint8_t recv_data(void)
@@ -37,6 +37,10 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #ifndef PS2_H
 #define PS2_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
 /*
  * Primitive PS/2 Library for AVR
  */
@@ -60,9 +64,21 @@ POSSIBILITY OF SUCH DAMAGE.
 #define PS2_ACK         0xFA
 #define PS2_RESEND      0xFE
 #define PS2_SET_LED     0xED
+#define PS2_SET_TYPEMATIC   0xF3
+#define PS2_ECHO        0xEE
+#define PS2_BAT_OK      0xAA
+#define PS2_BAT_ERR     0xFC
+#define PS2_KBD_ERROR   0xFF    // key detection error/buffer overrun(Set 2/3)
+#define PS2_RESET       0xFF
 
 #define PS2_ERR_NONE    0
 #define PS2_ERR_PARITY  0x10
+#define PS2_ERR_NODATA  0x20
+
+/* response to command must come in 20ms */
+#ifndef PS2_RESPONSE_TIMEOUT
+#   define PS2_RESPONSE_TIMEOUT 25
+#endif
 
 #define PS2_LED_SCROLL_LOCK 0
 #define PS2_LED_NUM_LOCK    1
@@ -78,6 +94,19 @@ uint8_t ps2_host_recv_response(void);
 uint8_t ps2_host_recv(void);
 void ps2_host_set_led(uint8_t usb_led);
 
+/* command without waiting for response: ps2_host_poll_response() returns
+ * the response or 0 while it has not come, give up with cancel. */
+bool ps2_host_send_async(uint8_t data);
+uint8_t ps2_host_poll_response(void);
+void ps2_host_cancel_response(void);
+
+/* deferred LED update(ps2_led.c) */
+extern uint8_t ps2_led_coalesced;
+void ps2_host_set_led_async(uint8_t led);
+void ps2_host_led_task(void);
+/* true while LED command waits for response */
+bool ps2_host_led_busy(void);
+
 /* device role */
 
 #endif
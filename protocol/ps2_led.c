@@ -0,0 +1,108 @@
+/*
+Copyright 2011 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Deferred LED update for PS/2 keyboard
+ *
+ * ps2_host_set_led_async() only records LED state and returns at once.
+ * ps2_host_led_task() is called from matrix_scan() and sends 0xED and then
+ * LED data with ps2_host_send_async(), taking each ack on a later call
+ * instead of waiting for it. State requested while previous one is not sent
+ * yet replaces it and only the latest one goes to the keyboard.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include "ps2.h"
+#include "timer.h"
+#include "debug.h"
+
+
+#define LED_RETRY 3
+
+uint8_t ps2_led_coalesced = 0;
+
+static uint8_t led_state = 0;
+static bool pending = false;
+static uint8_t retry = 0;
+static enum {
+    LED_IDLE,
+    LED_WAIT_COMMAND,       // 0xED sent
+    LED_WAIT_DATA,          // LED data sent
+} state = LED_IDLE;
+static uint16_t sent_time = 0;
+
+
+static bool send(uint8_t data)
+{
+    if (!ps2_host_send_async(data)) return false;
+    sent_time = timer_read();
+    return true;
+}
+
+/* start over from 0xED */
+static void failed(void)
+{
+    debug("LED: failed\n");
+    if (state == LED_WAIT_DATA) pending = true;
+    state = LED_IDLE;
+    if (!retry || !--retry) {
+        // keyboard is gone, drop it
+        pending = false;
+    }
+}
+
+void ps2_host_set_led_async(uint8_t led)
+{
+    if (pending && ps2_led_coalesced < 0xFF) ps2_led_coalesced++;
+    led_state = led;
+    pending = true;
+    retry = LED_RETRY;
+}
+
+bool ps2_host_led_busy(void)
+{
+    return (state != LED_IDLE);
+}
+
+void ps2_host_led_task(void)
+{
+    if (state == LED_IDLE) {
+        if (!pending) return;
+        state = LED_WAIT_COMMAND;
+        if (!send(PS2_SET_LED)) failed();
+        return;
+    }
+
+    uint8_t res = ps2_host_poll_response();
+    if (!res) {
+        if (timer_elapsed(sent_time) <= PS2_RESPONSE_TIMEOUT) return;
+        ps2_host_cancel_response();
+    }
+    if (res != PS2_ACK) {
+        failed();
+        return;
+    }
+
+    if (state == LED_WAIT_COMMAND) {
+        // keyboard sends no scan code until it gets LED data
+        pending = false;
+        state = LED_WAIT_DATA;
+        if (!send(led_state)) failed();
+    } else {
+        state = LED_IDLE;
+    }
+}
@@ -20,7 +20,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include<util/delay.h>
 #include "ps2.h"
 #include "ps2_mouse.h"
-#include "usb_mouse.h"
+#include "host.h"
+#include "timer.h"
 
 #define PS2_MOUSE_DEBUG
 #ifdef PS2_MOUSE_DEBUG
@@ -51,7 +52,6 @@ TODO
 ----
 - Stream mode
 - Tracpoint command support: needed
-- Middle button + move = Wheel traslation
 */
 bool ps2_mouse_enable = true;
 uint8_t ps2_mouse_x = 0;
@@ -61,6 +61,34 @@ uint8_t ps2_mouse_error_count = 0;
 
 static uint8_t ps2_mouse_btn_prev = 0;
 
+/* movement not sent yet, sent out by 127 per report */
+static int16_t motion_x = 0;
+static int16_t motion_y = 0;
+
+/* middle button scroll
+ *   SCROLL_OFF:   middle button is released
+ *   SCROLL_WAIT:  middle button is held and movement is under threshold.
+ *                 movement is held back and goes into wheel when scroll
+ *                 starts, or dropped as jitter of click
+ *   SCROLL_ON:    movement is translated into wheel until button is released
+ *   SCROLL_CLICK: button was released in SCROLL_WAIT, middle click is sent
+ *                 and held for PS2_MOUSE_CLICK_TIME
+ */
+static enum {
+    SCROLL_OFF,
+    SCROLL_WAIT,
+    SCROLL_ON,
+    SCROLL_CLICK,
+} scroll_state = SCROLL_OFF;
+static uint8_t scroll_moved = 0;
+static int16_t scroll_x = 0;
+static int16_t scroll_y = 0;
+static uint16_t scroll_time = 0;
+
+static int16_t scroll_amount(int16_t count);
+static inline int16_t packet_motion(uint8_t value, uint8_t sign, uint8_t ovflw);
+static inline int8_t motion_take(int16_t *motion, int16_t add);
+
 
 uint8_t ps2_mouse_init(void) {
     uint8_t rcv;
@@ -152,55 +180,70 @@ uint8_t ps2_mouse_read(void)
     return 0;
 }
 
-bool ps2_mouse_changed(void)
-{
-    return (ps2_mouse_x || ps2_mouse_y || (ps2_mouse_btn & PS2_MOUSE_BTN_MASK) != ps2_mouse_btn_prev);
-}
-
-#define PS2_MOUSE_SCROLL_BUTTON 0x04
 void ps2_mouse_usb_send(void)
 {
-    static bool scrolled = false;
-
     if (!ps2_mouse_enable) return;
 
-    if (ps2_mouse_changed()) {
-        int8_t x, y, v, h;
-        x = y = v = h = 0;
-
-        // convert scale of X, Y: PS/2(-256/255) -> USB(-127/127)
-        if (ps2_mouse_btn & (1<<PS2_MOUSE_X_SIGN))
-            x = ps2_mouse_x > 128 ? (int8_t)ps2_mouse_x : -127;
-        else
-            x = ps2_mouse_x < 128 ? (int8_t)ps2_mouse_x : 127;
-
-        if (ps2_mouse_btn & (1<<PS2_MOUSE_Y_SIGN))
-            y = ps2_mouse_y > 128 ? (int8_t)ps2_mouse_y : -127;
-        else
-            y = ps2_mouse_y < 128 ? (int8_t)ps2_mouse_y : 127;
-
-        // Y is needed to reverse
-        y = -y;
-
-        if (ps2_mouse_btn & PS2_MOUSE_SCROLL_BUTTON) {
-            // scroll
-            if (x > 0 || x < 0) h = (x > 64 ? 64 : (x < -64 ? -64 :x));
-            if (y > 0 || y < 0) v = (y > 64 ? 64 : (y < -64 ? -64 :y));
-            if (h || v) {
-                scrolled = true;
-                usb_mouse_send(0,0, -v/16, h/16, 0);
-                _delay_ms(100);
+    int16_t x, y;
+    uint8_t buttons = ps2_mouse_btn & PS2_MOUSE_BTN_MASK;
+    bool middle = buttons & PS2_MOUSE_SCROLL_BUTTON;
+    report_mouse_t report = { .buttons = buttons & ~PS2_MOUSE_SCROLL_BUTTON };
+
+    x = packet_motion(ps2_mouse_x, PS2_MOUSE_X_SIGN, PS2_MOUSE_X_OVFLW);
+    y = packet_motion(ps2_mouse_y, PS2_MOUSE_Y_SIGN, PS2_MOUSE_Y_OVFLW);
+
+    // Y is needed to reverse
+    y = -y;
+
+    if (scroll_state == SCROLL_CLICK) {
+        if (timer_elapsed(scroll_time) < PS2_MOUSE_CLICK_TIME) {
+            report.buttons |= PS2_MOUSE_SCROLL_BUTTON;
+        } else {
+            scroll_state = SCROLL_OFF;
+        }
+    }
+    if (scroll_state == SCROLL_OFF && middle) {
+        scroll_state = SCROLL_WAIT;
+        scroll_moved = 0;
+        scroll_x = scroll_y = 0;
+    }
+    if (scroll_state == SCROLL_WAIT) {
+        if (!middle) {
+            // released without scroll: middle click
+            scroll_state = SCROLL_CLICK;
+            scroll_time = timer_read();
+            report.buttons |= PS2_MOUSE_SCROLL_BUTTON;
+            x = y = 0;
+        } else {
+            uint16_t moved = (x < 0 ? -x : x) + (y < 0 ? -y : y);
+            scroll_moved = (moved < 255 - scroll_moved ? scroll_moved + moved : 255);
+            // at most threshold and a packet, no overflow
+            scroll_x += x;
+            scroll_y += y;
+            x = y = 0;
+            if (scroll_moved >= PS2_MOUSE_SCROLL_THRESHOLD) {
+                // scroll starts with movement held back
+                scroll_state = SCROLL_ON;
+                x = scroll_x;
+                y = scroll_y;
             }
-        } else if (!scrolled && (ps2_mouse_btn_prev & PS2_MOUSE_SCROLL_BUTTON)) {
-            usb_mouse_send(0,0,0,0, PS2_MOUSE_SCROLL_BUTTON);
-            _delay_ms(100);
-            usb_mouse_send(0,0,0,0, 0);
-        } else { 
-            scrolled = false;
-            usb_mouse_send(x, y, 0, 0, ps2_mouse_btn & PS2_MOUSE_BTN_MASK);
         }
+    }
+    if (scroll_state == SCROLL_ON) {
+        if (!middle) {
+            scroll_state = SCROLL_OFF;
+        } else if (x || y) {
+            host_wheel_add(scroll_amount(-y), scroll_amount(x));
+        }
+        x = y = 0;
+    }
 
-        ps2_mouse_btn_prev = (ps2_mouse_btn & PS2_MOUSE_BTN_MASK);
+    // PS/2 range is -256/255 while USB is -127/127, the rest goes next report
+    report.x = motion_take(&motion_x, x);
+    report.y = motion_take(&motion_y, y);
+    if (report.x || report.y || report.buttons != ps2_mouse_btn_prev || host_wheel_pending()) {
+        host_mouse_send(&report);
+        ps2_mouse_btn_prev = report.buttons;
         ps2_mouse_print();
     }
     ps2_mouse_x = 0;
@@ -208,6 +251,38 @@ void ps2_mouse_usb_send(void)
     ps2_mouse_btn = 0;
 }
 
+/* 9-bit movement of packet. overflowed movement is taken as its maximum */
+static inline int16_t packet_motion(uint8_t value, uint8_t sign, uint8_t ovflw)
+{
+    if (ps2_mouse_btn & (1<<sign)) {
+        return (ps2_mouse_btn & (1<<ovflw) ? -256 : (int16_t)value - 256);
+    } else {
+        return (ps2_mouse_btn & (1<<ovflw) ? 255 : value);
+    }
+}
+
+static inline int8_t motion_take(int16_t *motion, int16_t add)
+{
+    // add is -256/256 at most, saturate so that stuck host doesn't wrap around
+    if (add > 0 && *motion > INT16_MAX - 256) *motion = INT16_MAX - 256;
+    if (add < 0 && *motion < -INT16_MAX + 256) *motion = -INT16_MAX + 256;
+    *motion += add;
+
+    int8_t n = (*motion > 127 ? 127 : (*motion < -127 ? -127 : *motion));
+    *motion -= n;
+    return n;
+}
+
+/* wheel amount in 1/256 notch, faster movement scrolls more per count */
+static int16_t scroll_amount(int16_t count)
+{
+    int32_t amount = (int32_t)count * 256 / PS2_MOUSE_SCROLL_DIVISOR;
+#if PS2_MOUSE_SCROLL_ACCEL
+    amount = amount * (PS2_MOUSE_SCROLL_ACCEL + (count < 0 ? -count : count)) / PS2_MOUSE_SCROLL_ACCEL;
+#endif
+    return (amount > INT16_MAX ? INT16_MAX : (amount < -INT16_MAX ? -INT16_MAX : amount));
+}
+
 void ps2_mouse_print(void)
 {
     if (!debug_mouse) return;
@@ -29,6 +29,27 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define PS2_MOUSE_X_OVFLW       6
 #define PS2_MOUSE_Y_OVFLW       7
 
+/* middle button scroll, overridable in config.h */
+#ifndef PS2_MOUSE_SCROLL_BUTTON
+#   define PS2_MOUSE_SCROLL_BUTTON      (1<<PS2_MOUSE_BTN_MIDDLE)
+#endif
+/* counts to move with button held before scrolling starts, which are scrolled then */
+#ifndef PS2_MOUSE_SCROLL_THRESHOLD
+#   define PS2_MOUSE_SCROLL_THRESHOLD   8
+#endif
+/* counts per notch at slow movement */
+#ifndef PS2_MOUSE_SCROLL_DIVISOR
+#   define PS2_MOUSE_SCROLL_DIVISOR     16
+#endif
+/* counts per packet at which scroll speed is doubled, 0 for no acceleration */
+#ifndef PS2_MOUSE_SCROLL_ACCEL
+#   define PS2_MOUSE_SCROLL_ACCEL       16
+#endif
+/* ms to hold middle click sent on release without scroll */
+#ifndef PS2_MOUSE_CLICK_TIME
+#   define PS2_MOUSE_CLICK_TIME         10
+#endif
+
 bool ps2_mouse_enable;
 extern uint8_t ps2_mouse_x;
 extern uint8_t ps2_mouse_y;
@@ -37,7 +58,6 @@ extern uint8_t ps2_mouse_error_count;
 
 uint8_t ps2_mouse_init(void);
 uint8_t ps2_mouse_read(void);
-bool ps2_mouse_changed(void);
 void ps2_mouse_usb_send(void);
 void ps2_mouse_print(void);
 
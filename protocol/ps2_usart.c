@@ -43,6 +43,11 @@ Synchronous USART is used to receive data by hardware process
 rather than interrupt. During V-USB interrupt runs, CLOCK interrupt
 cannot interpose. In the result it is prone to lost CLOCK edge.
 
+Receive interrupt of USART is kept on except while host sends a command.
+Bytes which look like a response(ACK, RESEND, BAT result) are taken as
+the response while a command waits for it, other bytes go to the scan code
+buffer. Waiting for response is limited by PS2_RESPONSE_TIMEOUT(ms).
+
 
 I/O control
 -----------
@@ -82,6 +87,9 @@ http://www.mcamafia.de/pdf/ibm_hitrc07.pdf
 
 uint8_t ps2_error = PS2_ERR_NONE;
 
+/* number of commands waiting for response */
+static volatile uint8_t expect = 0;
+
 
 static inline void clock_lo(void);
 static inline void clock_hi(void);
@@ -97,6 +105,9 @@ static inline void idle(void);
 static inline void inhibit(void);
 static inline uint8_t pbuf_dequeue(void);
 static inline void pbuf_enqueue(uint8_t data);
+static inline uint8_t rbuf_dequeue(void);
+static inline void rbuf_enqueue(uint8_t data);
+static inline bool is_response(uint8_t data);
 
 
 void ps2_host_init(void)
@@ -110,7 +121,14 @@ void ps2_host_init(void)
 
 uint8_t ps2_host_send(uint8_t data)
 {
-    uint8_t res = 0;
+    if (!ps2_host_send_async(data)) return 0;
+    return ps2_host_recv_response();
+}
+
+// Send command and return without waiting for response. Bits still clock
+// out here, no edge interrupt on clock line in USART mode.
+bool ps2_host_send_async(uint8_t data)
+{
     bool parity = true;
     ps2_error = PS2_ERR_NONE;
 
@@ -153,26 +171,52 @@ uint8_t ps2_host_send(uint8_t data)
     WAIT(clock_hi, 50, 8);
     WAIT(data_hi, 50, 9);
 
-    res = ps2_host_recv_response();
+    /* receive response with interrupt */
+    expect++;
+    idle();
+    PS2_USART_INIT();
+    PS2_USART_RX_INT_ON();
+    return true;
 ERROR:
     idle();
     PS2_USART_INIT();
     PS2_USART_RX_INT_ON();
-    return res;
+    return false;
 }
 
-// Do polling data from keyboard to get response to last command.
+// Get response to last command, or next byte from keyboard when no command
+// is waiting for response. Returns 0 with PS2_ERR_NODATA on timeout.
+// Timeout is counted with delay instead of timer so that this returns
+// even when called with interrupts disabled.
 uint8_t ps2_host_recv_response(void)
 {
-    uint8_t data = 0;
-    PS2_USART_INIT();
-    PS2_USART_RX_POLL_ON();
-    while (!PS2_USART_RX_READY)
-        ;
-    data = PS2_USART_RX_DATA;
-    PS2_USART_OFF();
-    DEBUGP(0x9);
-    return data;
+    uint8_t data;
+    uint16_t wait = PS2_RESPONSE_TIMEOUT * 100;
+    do {
+        data = rbuf_dequeue();
+        if (!data && !expect) data = pbuf_dequeue();
+        if (data) {
+            DEBUGP(0x9);
+            return data;
+        }
+        _delay_us(10);
+    } while (--wait);
+
+    // give up; later bytes are not taken as the response
+    expect = 0;
+    ps2_error = PS2_ERR_NODATA;
+    return 0;
+}
+
+uint8_t ps2_host_poll_response(void)
+{
+    return rbuf_dequeue();
+}
+
+void ps2_host_cancel_response(void)
+{
+    // later bytes are not taken as the response
+    expect = 0;
 }
 
 uint8_t ps2_host_recv(void)
@@ -187,6 +231,9 @@ ISR(PS2_USART_RX_VECT)
     uint8_t data = PS2_USART_RX_DATA;
     if (error) {
         DEBUGP(error>>2);
+    } else if (expect && is_response(data)) {
+        expect--;
+        rbuf_enqueue(data);
     } else {
         pbuf_enqueue(data);
     }
@@ -322,3 +369,49 @@ static inline uint8_t pbuf_dequeue(void)
 
     return val;
 }
+
+
+/*--------------------------------------------------------------------
+ * Buffer to store responses to commands
+ *------------------------------------------------------------------*/
+#define RBUF_SIZE 4
+static uint8_t rbuf[RBUF_SIZE];
+static uint8_t rbuf_head = 0;
+static uint8_t rbuf_tail = 0;
+static inline void rbuf_enqueue(uint8_t data)
+{
+    /* called from ISR */
+    uint8_t next = (rbuf_head + 1) % RBUF_SIZE;
+    if (next != rbuf_tail) {
+        rbuf[rbuf_head] = data;
+        rbuf_head = next;
+    }
+}
+
+static inline uint8_t rbuf_dequeue(void)
+{
+    uint8_t val = 0;
+
+    uint8_t sreg = SREG;
+    cli();
+    if (rbuf_head != rbuf_tail) {
+        val = rbuf[rbuf_tail];
+        rbuf_tail = (rbuf_tail + 1) % RBUF_SIZE;
+    }
+    SREG = sreg;
+
+    return val;
+}
+
+static inline bool is_response(uint8_t data)
+{
+    switch (data) {
+        case PS2_ACK:
+        case PS2_RESEND:
+        case PS2_BAT_OK:
+        case PS2_BAT_ERR:
+        case PS2_ECHO:
+            return true;
+    }
+    return false;
+}
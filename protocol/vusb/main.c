@@ -20,6 +20,9 @@
 #include "timer.h"
 #include "uart.h"
 #include "debug.h"
+#ifdef POWER_SAVE_ENABLE
+#   include "power.h"
+#endif
 
 
 #define UART_BAUD_RATE 115200
@@ -93,7 +96,12 @@ int main(void)
         if (!suspended)
             usbPoll();
         keyboard_proc();
-        if (!suspended)
+        if (!suspended) {
             vusb_transfer_keyboard();
+            vusb_transfer_idle();
+        }
+#ifdef POWER_SAVE_ENABLE
+        power_idle();
+#endif
     }
 }
@@ -16,6 +16,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <util/delay.h>
 #include "usbdrv.h"
 #include "usbconfig.h"
 #include "host.h"
@@ -23,34 +28,112 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "print.h"
 #include "debug.h"
 #include "host_driver.h"
+#include "timer.h"
+#include "idle_rate.h"
 #include "vusb.h"
 
 
 static uint8_t vusb_keyboard_leds = 0;
-static uint8_t vusb_idle_rate = 0;
+static uint8_t vusb_idle_reply = 0;
+static uint8_t vusb_wheel_feature[] = { REPORT_ID_MOUSE, 0 };
 
-/* Keyboard report send buffer */
+/* Last reports handed to driver, repeated when idle duration elapses */
+static report_keyboard_t keyboard_report_sent;
+static report_mouse_t mouse_report_sent;
+static uint8_t system_report[] = { REPORT_ID_SYSTEM, 0, 0 };
+static uint8_t consumer_report[] = { REPORT_ID_CONSUMER, 0, 0 };
+
+/* Keyboard report send queue
+ *
+ * Reports are queued by send_keyboard() and handed to the driver one per
+ * interrupt transfer as usbInterruptIsReady() allows. A report identical to
+ * the newest one queued(or last sent when empty) is merged. When the queue
+ * is full the newest entry is overwritten so that the latest state always
+ * reaches the host.
+ */
 #define KBUF_SIZE 16
 static report_keyboard_t kbuf[KBUF_SIZE];
 static uint8_t kbuf_head = 0;
 static uint8_t kbuf_tail = 0;
 
+/* debug counters */
+uint8_t vusb_kbuf_max = 0;      // high-water mark of queue depth
+uint8_t vusb_kbuf_merged = 0;
+uint8_t vusb_kbuf_overflow = 0;
+
+/* polling interval of interrupt endpoints in ms, patched into config descriptor */
+uint8_t vusb_polling_interval = USB_CFG_INTR_POLL_INTERVAL;
+/* ms between last two reports taken back to back by host */
+uint8_t vusb_keyboard_interval = 0;
+
 
 /* transfer keyboard report from buffer */
 void vusb_transfer_keyboard(void)
 {
-    if (usbInterruptIsReady()) {
-        if (kbuf_head != kbuf_tail) {
-            usbSetInterrupt((void *)&kbuf[kbuf_tail], sizeof(report_keyboard_t));
-            if (!debug_keyboard) {
-                print("keys: ");
-                for (int i = 0; i < REPORT_KEYS; i++) { phex(kbuf[kbuf_tail].keys[i]); print(" "); }
-                print(" mods: "); phex((kbuf[kbuf_tail]).mods); print("\n");
-            }
-            kbuf_tail = (kbuf_tail + 1) % KBUF_SIZE;
-            print("buf"); phex(kbuf_head), phex(kbuf_tail);print("\n")
+    static uint16_t last_time = 0;
+    static bool blocked = false;
+
+    if (kbuf_head == kbuf_tail) return;
+    if (!usbInterruptIsReady()) {
+        blocked = true;
+        return;
+    }
+    if (blocked) {
+        uint16_t elapsed = timer_elapsed(last_time);
+        vusb_keyboard_interval = (elapsed > 0xFF) ? 0xFF : elapsed;
+        blocked = false;
+    }
+    last_time = timer_read();
+
+    usbSetInterrupt((void *)&kbuf[kbuf_tail], sizeof(report_keyboard_t));
+    keyboard_report_sent = kbuf[kbuf_tail];
+    idle_rate_restart(IDLE_RATE_KEYBOARD);
+    kbuf_tail = (kbuf_tail + 1) % KBUF_SIZE;
+}
+
+/* repeat reports whose idle duration elapsed */
+void vusb_transfer_idle(void)
+{
+    static uint16_t last_timer = 0;
+    uint16_t elapsed = timer_elapsed(last_timer);
+    if (!elapsed) return;
+    last_timer += elapsed;
+
+    uint8_t idle = idle_rate_tick(elapsed > 0xFF ? 0xFF : elapsed);
+    if (!idle) return;
+
+    // queued report is newer than idle one
+    if ((idle & (1<<IDLE_RATE_KEYBOARD)) && kbuf_head == kbuf_tail) {
+        if (usbInterruptIsReady()) {
+            usbSetInterrupt((void *)&keyboard_report_sent, sizeof(report_keyboard_t));
         }
     }
+
+    // endpoint3 is shared; one report per transfer and the others wait for next period
+    if (!usbInterruptIsReady3()) return;
+    if (idle & (1<<REPORT_ID_MOUSE)) {
+        // movement is relative and must not be repeated
+        report_mouse_t report = { .report_id = REPORT_ID_MOUSE, .buttons = mouse_report_sent.buttons };
+        usbSetInterrupt3((void *)&report, sizeof(report));
+    } else if (idle & (1<<REPORT_ID_SYSTEM)) {
+        usbSetInterrupt3((void *)&system_report, sizeof(system_report));
+    } else if (idle & (1<<REPORT_ID_CONSUMER)) {
+        usbSetInterrupt3((void *)&consumer_report, sizeof(consumer_report));
+    }
+}
+
+
+/* change polling interval; host reads it only on enumeration */
+void vusb_set_polling_interval(uint8_t ms)
+{
+    if (ms == vusb_polling_interval) return;
+    vusb_polling_interval = ms;
+
+    cli();
+    usbDeviceDisconnect();
+    _delay_ms(250);
+    usbDeviceConnect();
+    sei();
 }
 
 
@@ -82,15 +165,28 @@ static uint8_t keyboard_leds(void) {
 
 static void send_keyboard(report_keyboard_t *report)
 {
-    return;
+    uint8_t last = (kbuf_head + KBUF_SIZE - 1) % KBUF_SIZE;
+    report_keyboard_t *newest = (kbuf_head == kbuf_tail) ? &keyboard_report_sent : &kbuf[last];
+    if (memcmp(newest, report, sizeof(report_keyboard_t)) == 0) {
+        if (vusb_kbuf_merged < 0xFF) vusb_kbuf_merged++;
+        return;
+    }
+
     uint8_t next = (kbuf_head + 1) % KBUF_SIZE;
     if (next != kbuf_tail) {
         kbuf[kbuf_head] = *report;
         kbuf_head = next;
-        print("key\n")
     } else {
-        print("kbuf: full\n");
+        // full: replace newest with latest state
+        kbuf[last] = *report;
+        if (vusb_kbuf_overflow < 0xFF) vusb_kbuf_overflow++;
     }
+
+    uint8_t depth = (kbuf_head + KBUF_SIZE - kbuf_tail) % KBUF_SIZE;
+    if (depth > vusb_kbuf_max) vusb_kbuf_max = depth;
+
+    // start transfer now if endpoint is free
+    vusb_transfer_keyboard();
 }
 
 
@@ -99,17 +195,18 @@ static void send_mouse(report_mouse_t *report)
     report->report_id = REPORT_ID_MOUSE;
     if (usbInterruptIsReady3()) {
         usbSetInterrupt3((void *)report, sizeof(*report));
+        mouse_report_sent = *report;
+        idle_rate_restart(REPORT_ID_MOUSE);
     }
 }
 
 static void send_system(uint16_t data)
 {
-    // Not need static?
-    static uint8_t report[] = { REPORT_ID_SYSTEM, 0, 0 };
-    report[1] = data&0xFF;
-    report[2] = (data>>8)&0xFF;
+    system_report[1] = data&0xFF;
+    system_report[2] = (data>>8)&0xFF;
     if (usbInterruptIsReady3()) {
-        usbSetInterrupt3((void *)&report, sizeof(report));
+        usbSetInterrupt3((void *)&system_report, sizeof(system_report));
+        idle_rate_restart(REPORT_ID_SYSTEM);
     }
 }
 
@@ -119,12 +216,11 @@ static void send_consumer(uint16_t data)
     if (data == last_data) return;
     last_data = data;
 
-    // Not need static?
-    static uint8_t report[] = { REPORT_ID_CONSUMER, 0, 0 };
-    report[1] = data&0xFF;
-    report[2] = (data>>8)&0xFF;
+    consumer_report[1] = data&0xFF;
+    consumer_report[2] = (data>>8)&0xFF;
     if (usbInterruptIsReady3()) {
-        usbSetInterrupt3((void *)&report, sizeof(report));
+        usbSetInterrupt3((void *)&consumer_report, sizeof(consumer_report));
+        idle_rate_restart(REPORT_ID_CONSUMER);
     }
 }
 
@@ -137,7 +233,8 @@ static struct {
     uint16_t        len;
     enum {
         NONE,
-        SET_LED
+        SET_LED,
+        SET_WHEEL
     }               kind;
 } last_req;
 
@@ -148,18 +245,39 @@ usbRequest_t    *rq = (void *)data;
     if((rq->bmRequestType & USBRQ_TYPE_MASK) == USBRQ_TYPE_CLASS){    /* class request type */
         if(rq->bRequest == USBRQ_HID_GET_REPORT){
             debug("GET_REPORT:");
-            /* we only have one report type, so don't look at wValue */
+            // Report Type: 0x03(Feature)/ReportID: mouse && Interface: 1
+            if (rq->wValue.word == (0x0300 | REPORT_ID_MOUSE) && rq->wIndex.word == 1) {
+                vusb_wheel_feature[1] = host_wheel_hires;
+                usbMsgPtr = vusb_wheel_feature;
+                return sizeof(vusb_wheel_feature);
+            }
             usbMsgPtr = (void *)keyboard_report_prev;
             return sizeof(*keyboard_report_prev);
         }else if(rq->bRequest == USBRQ_HID_GET_IDLE){
             debug("GET_IDLE: ");
-            //debug_hex(vusb_idle_rate);
-            usbMsgPtr = &vusb_idle_rate;
+            // Interface: 0(keyboard)/1(mouse, system and consumer with report ID)
+            if (rq->wIndex.word == 0) {
+                vusb_idle_reply = idle_rate_get(IDLE_RATE_KEYBOARD);
+            } else {
+                vusb_idle_reply = idle_rate_get(rq->wValue.bytes[0] ? rq->wValue.bytes[0] : REPORT_ID_MOUSE);
+            }
+            //debug_hex(vusb_idle_reply);
+            usbMsgPtr = &vusb_idle_reply;
             return 1;
         }else if(rq->bRequest == USBRQ_HID_SET_IDLE){
-            vusb_idle_rate = rq->wValue.bytes[1];
             debug("SET_IDLE: ");
-            debug_hex(vusb_idle_rate);
+            debug_hex(rq->wValue.bytes[0]); debug(" ");
+            debug_hex(rq->wValue.bytes[1]);
+            if (rq->wIndex.word == 0) {
+                idle_rate_set(IDLE_RATE_KEYBOARD, rq->wValue.bytes[1]);
+            } else if (rq->wValue.bytes[0] == 0) {
+                // report ID 0 applies to all reports on the interface
+                idle_rate_set(REPORT_ID_MOUSE, rq->wValue.bytes[1]);
+                idle_rate_set(REPORT_ID_SYSTEM, rq->wValue.bytes[1]);
+                idle_rate_set(REPORT_ID_CONSUMER, rq->wValue.bytes[1]);
+            } else {
+                idle_rate_set(rq->wValue.bytes[0], rq->wValue.bytes[1]);
+            }
         }else if(rq->bRequest == USBRQ_HID_SET_REPORT){
             debug("SET_REPORT: ");
             // Report Type: 0x02(Out)/ReportID: 0x00(none) && Interface: 0(keyboard)
@@ -168,6 +286,12 @@ usbRequest_t    *rq = (void *)data;
                 last_req.kind = SET_LED;
                 last_req.len = rq->wLength.word;
             }
+            // Report Type: 0x03(Feature)/ReportID: mouse && Interface: 1
+            if (rq->wValue.word == (0x0300 | REPORT_ID_MOUSE) && rq->wIndex.word == 1) {
+                debug("SET_WHEEL: ");
+                last_req.kind = SET_WHEEL;
+                last_req.len = rq->wLength.word;
+            }
             return USB_NO_MSG; // to get data in usbFunctionWrite
         } else {
             debug("UNKNOWN:");
@@ -194,6 +318,15 @@ uchar usbFunctionWrite(uchar *data, uchar len)
             last_req.len = 0;
             return 1;
             break;
+        case SET_WHEEL:
+            // data[0] is report ID
+            debug("SET_WHEEL: ");
+            debug_hex(data[1]);
+            debug("\n");
+            host_wheel_hires = data[1];
+            last_req.len = 0;
+            return 1;
+            break;
         case NONE:
         default:
             return -1;
@@ -255,6 +388,7 @@ PROGMEM uchar keyboard_hid_report[] = {
  * http://www.microchip.com/forums/tm.aspx?high=&m=391435&mpage=1#391521
  * http://www.keil.com/forum/15671/
  * http://www.microsoft.com/whdc/device/input/wheel.mspx
+ * Resolution Multiplier lets host take wheel in 1/HOST_WHEEL_MULTIPLIER notch
  */
 PROGMEM uchar mouse_hid_report[] = {
     /* mouse */
@@ -286,22 +420,40 @@ PROGMEM uchar mouse_hid_report[] = {
     0x95, 0x02,                    //     REPORT_COUNT (2)
     0x81, 0x06,                    //     INPUT (Data,Var,Rel)
                                    // ----------------------------  Vertical wheel
-    0x09, 0x38,                    //     USAGE (Wheel)
-    0x15, 0x81,                    //     LOGICAL_MINIMUM (-127)
-    0x25, 0x7f,                    //     LOGICAL_MAXIMUM (127)
-    0x35, 0x00,                    //     PHYSICAL_MINIMUM (0)        - reset physical
-    0x45, 0x00,                    //     PHYSICAL_MAXIMUM (0)
-    0x75, 0x08,                    //     REPORT_SIZE (8)
-    0x95, 0x01,                    //     REPORT_COUNT (1)
-    0x81, 0x06,                    //     INPUT (Data,Var,Rel)
+    0xa1, 0x02,                    //     COLLECTION (Logical)
+    0x09, 0x48,                    //       USAGE (Resolution Multiplier)
+    0x15, 0x00,                    //       LOGICAL_MINIMUM (0)
+    0x25, 0x01,                    //       LOGICAL_MAXIMUM (1)
+    0x35, 0x01,                    //       PHYSICAL_MINIMUM (1)
+    0x45, HOST_WHEEL_MULTIPLIER,   //       PHYSICAL_MAXIMUM (8)
+    0x75, 0x02,                    //       REPORT_SIZE (2)
+    0x95, 0x01,                    //       REPORT_COUNT (1)
+    0xa4,                          //       PUSH
+    0xb1, 0x02,                    //       FEATURE (Data,Var,Abs)
+    0x09, 0x38,                    //       USAGE (Wheel)
+    0x15, 0x81,                    //       LOGICAL_MINIMUM (-127)
+    0x25, 0x7f,                    //       LOGICAL_MAXIMUM (127)
+    0x35, 0x00,                    //       PHYSICAL_MINIMUM (0)        - reset physical
+    0x45, 0x00,                    //       PHYSICAL_MAXIMUM (0)
+    0x75, 0x08,                    //       REPORT_SIZE (8)
+    0x81, 0x06,                    //       INPUT (Data,Var,Rel)
+    0xc0,                          //     END_COLLECTION
                                    // ----------------------------  Horizontal wheel
-    0x05, 0x0c,                    //     USAGE_PAGE (Consumer Devices)
-    0x0a, 0x38, 0x02,              //     USAGE (AC Pan)
-    0x15, 0x81,                    //     LOGICAL_MINIMUM (-127)
-    0x25, 0x7f,                    //     LOGICAL_MAXIMUM (127)
-    0x75, 0x08,                    //     REPORT_SIZE (8)
-    0x95, 0x01,                    //     REPORT_COUNT (1)
-    0x81, 0x06,                    //     INPUT (Data,Var,Rel)
+    0xa1, 0x02,                    //     COLLECTION (Logical)
+    0x09, 0x48,                    //       USAGE (Resolution Multiplier)
+    0xb4,                          //       POP
+    0xb1, 0x02,                    //       FEATURE (Data,Var,Abs)
+    0x35, 0x00,                    //       PHYSICAL_MINIMUM (0)        - reset physical
+    0x45, 0x00,                    //       PHYSICAL_MAXIMUM (0)
+    0x75, 0x04,                    //       REPORT_SIZE (4)
+    0xb1, 0x03,                    //       FEATURE (Cnst,Var,Abs)      - padding
+    0x05, 0x0c,                    //       USAGE_PAGE (Consumer Devices)
+    0x0a, 0x38, 0x02,              //       USAGE (AC Pan)
+    0x15, 0x81,                    //       LOGICAL_MINIMUM (-127)
+    0x25, 0x7f,                    //       LOGICAL_MAXIMUM (127)
+    0x75, 0x08,                    //       REPORT_SIZE (8)
+    0x81, 0x06,                    //       INPUT (Data,Var,Rel)
+    0xc0,                          //     END_COLLECTION
     0xc0,                          //   END_COLLECTION
     0xc0,                          // END_COLLECTION
     /* system control */
@@ -435,9 +587,16 @@ USB_PUBLIC usbMsgLen_t usbFunctionDescriptor(struct usbRequest *rq)
     switch (rq->wValue.bytes[1]) {
 #if USB_CFG_DESCR_PROPS_CONFIGURATION
         case USBDESCR_CONFIG:
-            usbMsgPtr = (unsigned char *)usbDescriptorConfiguration;
+        {
+            // RAM copy with runtime bInterval(USB_PROP_IS_RAM in usbconfig.h)
+            static uchar config[sizeof(usbDescriptorConfiguration)];
+            memcpy_P(config, usbDescriptorConfiguration, sizeof(config));
+            config[9 + (9 + 9 + 7) - 1] = vusb_polling_interval;
+            config[9 + (9 + 9 + 7) + (9 + 9 + 7) - 1] = vusb_polling_interval;
+            usbMsgPtr = config;
             len = sizeof(usbDescriptorConfiguration);
             break;
+        }
 #endif
         case USBDESCR_HID:
             switch (rq->wValue.bytes[0]) {
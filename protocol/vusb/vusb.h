@@ -21,7 +21,15 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "host_driver.h"
 
 
+extern uint8_t vusb_kbuf_max;
+extern uint8_t vusb_kbuf_merged;
+extern uint8_t vusb_kbuf_overflow;
+extern uint8_t vusb_polling_interval;
+extern uint8_t vusb_keyboard_interval;
+
 host_driver_t *vusb_driver(void);
 void vusb_transfer_keyboard(void);
+void vusb_transfer_idle(void);
+void vusb_set_polling_interval(uint8_t ms);
 
 #endif
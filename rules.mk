@@ -313,6 +313,13 @@ MSG_CREATING_LIBRARY = Creating library:
 # Define all object files.
 OBJ = $(patsubst %.c,$(OBJDIR)/%.o,$(patsubst %.cpp,$(OBJDIR)/%.o,$(patsubst %.S,$(OBJDIR)/%.o,$(SRC))))
 
+# Packed keymap(KEYMAP_PACK_ENABLE): keymap source is compiled once more
+# as dense keymap and converted by tool/keymap_pack.py.
+ifdef KEYMAP_PACK_ENABLE
+KEYMAP_PACK_SRC ?= keymap.c
+OBJ += $(OBJDIR)/keymap_packed.o
+endif
+
 # Define all listing files.
 LST = $(patsubst %.c,$(OBJDIR)/%.lst,$(patsubst %.cpp,$(OBJDIR)/%.lst,$(patsubst %.S,$(OBJDIR)/%.lst,$(SRC))))
 
@@ -492,6 +499,24 @@ $(OBJDIR)/%.o : %.c
 	$(CC) -c $(ALL_CFLAGS) $< -o $@ 
 
 
+ifdef KEYMAP_PACK_ENABLE
+$(OBJDIR)/keymap_dense.o : $(TOP_DIR)/common/keymap_dense.c $(KEYMAP_PACK_SRC)
+	@echo
+	@echo $(MSG_COMPILING) $(KEYMAP_PACK_SRC) "(dense keymap)"
+	$(CC) -c $(ALL_CFLAGS) -UKEYMAP_PACK_ENABLE -DKEYMAP_PACK_DENSE \
+		-DKEYMAP_PACK_SRC='"$(KEYMAP_PACK_SRC)"' $< -o $@
+
+$(OBJDIR)/keymap_packed.c : $(OBJDIR)/keymap_dense.o
+	@echo
+	python $(TOP_DIR)/tool/keymap_pack.py $< $@
+
+$(OBJDIR)/keymap_packed.o : $(OBJDIR)/keymap_packed.c
+	@echo
+	@echo $(MSG_COMPILING) $<
+	$(CC) -c $(ALL_CFLAGS) $< -o $@
+endif
+
+
 # Compile: create object files from C++ source files.
 $(OBJDIR)/%.o : %.cpp
 	@echo
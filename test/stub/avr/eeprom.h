@@ -0,0 +1,19 @@
+/* Host test stub: a test using EEPROM defines these on its array. */
+#ifndef AVR_EEPROM_H
+#define AVR_EEPROM_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define EEMEM
+
+uint8_t eeprom_read_byte(const uint8_t *p);
+void eeprom_write_byte(uint8_t *p, uint8_t value);
+void eeprom_update_byte(uint8_t *p, uint8_t value);
+uint16_t eeprom_read_word(const uint16_t *p);
+void eeprom_update_word(uint16_t *p, uint16_t value);
+void eeprom_read_block(void *dst, const void *src, size_t n);
+void eeprom_update_block(const void *src, void *dst, size_t n);
+int eeprom_is_ready(void);
+
+#endif
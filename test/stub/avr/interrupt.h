@@ -0,0 +1,11 @@
+/* Host test stub: interrupt flag is bit 7 of SREG like real one. */
+#ifndef AVR_INTERRUPT_H
+#define AVR_INTERRUPT_H 1
+
+#include <avr/io.h>
+
+#define ISR(vect)   void vect(void)
+#define cli()       (SREG &= ~0x80)
+#define sei()       (SREG |= 0x80)
+
+#endif
@@ -0,0 +1,9 @@
+/* Host test stub: only status register, ports are declared by each test. */
+#ifndef AVR_IO_H
+#define AVR_IO_H 1
+
+#include <stdint.h>
+
+extern volatile uint8_t SREG;
+
+#endif
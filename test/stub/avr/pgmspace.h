@@ -0,0 +1,14 @@
+/* Host test stub: flash is ordinary memory. */
+#ifndef AVR_PGMSPACE_H
+#define AVR_PGMSPACE_H 1
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s)             (s)
+#define pgm_read_byte(p)    (*(const uint8_t *)(p))
+#define pgm_read_word(p)    (*(const uint16_t *)(p))
+#define memcpy_P            memcpy
+
+#endif
@@ -0,0 +1,8 @@
+/* Host test stub: a test using delays defines these to advance its clock. */
+#ifndef UTIL_DELAY_H
+#define UTIL_DELAY_H 1
+
+void _delay_us(double us);
+void _delay_ms(double ms);
+
+#endif
@@ -0,0 +1,88 @@
+/*
+Copyright 2011 Jun Wako <wakojun@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Minimal host test support
+ *
+ * A test includes this and then the source file under test, so that it can
+ * see static variables and functions. print.h functions write to test_log
+ * which a test can search for debug messages.
+ */
+#ifndef TEST_H
+#define TEST_H 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+
+static int test_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+        test_failures++; \
+    } \
+} while (0)
+
+#define CHECK_EQ(a, b) do { \
+    long _a = (long)(a), _b = (long)(b); \
+    if (_a != _b) { \
+        printf("%s:%d: CHECK_EQ(%s, %s) failed: %ld != %ld\n", \
+               __FILE__, __LINE__, #a, #b, _a, _b); \
+        test_failures++; \
+    } \
+} while (0)
+
+#define TEST_RESULT() (printf("%s: %s\n", __FILE__, test_failures ? "FAIL" : "ok"), \
+                       test_failures ? 1 : 0)
+
+
+/* print.h */
+volatile uint8_t SREG = 0x80;
+bool print_enable = true;
+static char test_log[4096];
+static size_t test_log_len = 0;
+
+static inline void test_log_clear(void)
+{
+    test_log_len = 0;
+    test_log[0] = '\0';
+}
+
+static inline bool test_log_has(const char *s)
+{
+    return strstr(test_log, s) != NULL;
+}
+
+void print_S(const char *s)
+{
+    size_t n = strlen(s);
+    if (test_log_len + n >= sizeof(test_log)) test_log_len = 0;
+    memcpy(test_log + test_log_len, s, n + 1);
+    test_log_len += n;
+}
+void print_P(const char *s) { print_S(s); }
+void phex(unsigned char c) { char b[3]; snprintf(b, sizeof(b), "%02X", c); print_S(b); }
+void phex16(unsigned int i) { char b[5]; snprintf(b, sizeof(b), "%04X", i); print_S(b); }
+void pbin(unsigned char c) { for (int i = 7; i >= 0; i--) print_S((c & (1<<i)) ? "1" : "0"); }
+void pbin_reverse(unsigned char c) { for (int i = 0; i < 8; i++) print_S((c & (1<<i)) ? "1" : "0"); }
+void print_fmt_P(const char *fmt, uint16_t a, uint16_t b) { print_S(fmt); phex16(a); phex16(b); }
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ * ghost.c: ambiguous keys on every 4x4 matrix(covers every 3x3 too)
+ * against brute force rectangle search
+ */
+#include "test.h"
+
+#define MATRIX_ROWS 4
+#define MATRIX_COLS 4
+
+static uint8_t sim_matrix[MATRIX_ROWS];
+uint8_t matrix_get_row(uint8_t row) { return sim_matrix[row]; }
+
+#include "ghost.c"
+
+
+static bool on(uint8_t r, uint8_t c)
+{
+    return sim_matrix[r] & (1<<c);
+}
+
+/* key is a corner of rectangle of keys on */
+static bool is_ambiguous(uint8_t r, uint8_t c)
+{
+    if (!on(r, c)) return false;
+    for (uint8_t r2 = 0; r2 < MATRIX_ROWS; r2++) {
+        if (r2 == r || !on(r2, c)) continue;
+        for (uint8_t c2 = 0; c2 < MATRIX_COLS; c2++) {
+            if (c2 != c && on(r, c2) && on(r2, c2)) return true;
+        }
+    }
+    return false;
+}
+
+static void set(uint16_t m)
+{
+    for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+        sim_matrix[r] = (m >> (r * MATRIX_COLS)) & 0x0F;
+    }
+}
+
+static void press(uint8_t r, uint8_t c)
+{
+    sim_matrix[r] |= (1<<c);
+    ghost_update();
+}
+
+
+int main(void)
+{
+    uint32_t errors = 0;
+
+    for (uint32_t m = 1; m < 0x10000; m++) {
+        // from no key
+        set(0);
+        ghost_update();
+        set(m);
+        CHECK(ghost_update());
+
+        bool any = false;
+        for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+            for (uint8_t c = 0; c < MATRIX_COLS; c++) {
+                bool amb = is_ambiguous(r, c);
+                any |= amb;
+                if (amb != (bool)(ghost_get_row(r) & (1<<c))) errors++;
+                // ambiguous key holds off, others are reported
+                if (ghost_is_on(r, c) != (on(r, c) && !amb)) errors++;
+            }
+        }
+        if (any != ghost_exists()) errors++;
+        if (errors) {
+            printf("first error at matrix %04X\n", (unsigned)m);
+            break;
+        }
+    }
+    CHECK_EQ(errors, 0);
+
+    // no change
+    CHECK(!ghost_update());
+
+    // L shape is not ambiguous: its row and column have other keys
+    set(0); ghost_update();
+    press(0, 0); press(0, 1); press(1, 0);
+    CHECK(!ghost_exists());
+    CHECK(ghost_is_on(0, 0) && ghost_is_on(0, 1) && ghost_is_on(1, 0));
+
+    // ghost at fourth corner: real keys hold on, ghost holds off
+    press(1, 1);
+    CHECK(ghost_exists());
+    CHECK_EQ(ghost_get_row(0), 0x03);
+    CHECK_EQ(ghost_get_row(1), 0x03);
+    CHECK(ghost_is_on(0, 0) && ghost_is_on(0, 1) && ghost_is_on(1, 0));
+    CHECK(!ghost_is_on(1, 1));
+
+    // unrelated key is reported while ghost exists
+    press(3, 3);
+    CHECK(ghost_is_on(3, 3));
+
+    // rectangle broken: state follows matrix again
+    sim_matrix[0] &= ~(1<<0);
+    ghost_update();
+    CHECK(!ghost_exists());
+    CHECK(!ghost_is_on(0, 0));
+    CHECK(ghost_is_on(1, 1));
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,291 @@
+/*
+ * keymap_overlay.c against simulated EEPROM
+ *
+ * EEPROM is an array erased to 0xFF which is busy for a scan after each
+ * byte written. keymap_overlay_task() is called once per simulated
+ * millisecond like from keyboard_proc(), and a reboot is simulated by
+ * clearing RAM image and loading it again.
+ */
+#include "test.h"
+
+#define MATRIX_ROWS 4
+#define MATRIX_COLS 4
+
+#include "keymap_overlay.c"
+
+
+/* EEPROM */
+#define E2SIZE 1024
+static uint8_t eeprom[E2SIZE];
+static uint32_t eeprom_written[E2SIZE];
+static bool eeprom_busy = false;
+
+uint8_t eeprom_read_byte(const uint8_t *p)
+{
+    CHECK((uintptr_t)p < E2SIZE);
+    return eeprom[(uintptr_t)p];
+}
+void eeprom_write_byte(uint8_t *p, uint8_t value)
+{
+    CHECK((uintptr_t)p < E2SIZE);
+    CHECK(!eeprom_busy);
+    eeprom[(uintptr_t)p] = value;
+    eeprom_written[(uintptr_t)p]++;
+    eeprom_busy = true;
+}
+void eeprom_read_block(void *dst, const void *src, size_t n)
+{
+    CHECK((uintptr_t)src + n <= E2SIZE);
+    memcpy(dst, eeprom + (uintptr_t)src, n);
+}
+int eeprom_is_ready(void)
+{
+    return !eeprom_busy;
+}
+
+static uint32_t writes_total(void)
+{
+    uint32_t n = 0;
+    for (uint16_t i = 0; i < E2SIZE; i++) n += eeprom_written[i];
+    return n;
+}
+
+/* bytes written outside of overlay */
+static uint32_t writes_outside(void)
+{
+    uint32_t n = 0;
+    for (uint16_t i = 0; i < E2SIZE; i++) {
+        if (i < KEYMAP_OVERLAY_EEPROM_ADDR || i >= KEYMAP_OVERLAY_EEPROM_ADDR + KEYMAP_OVERLAY_EEPROM_SIZE)
+            n += eeprom_written[i];
+    }
+    return n;
+}
+
+
+/* timer */
+static uint16_t sim_ms = 0;
+uint16_t timer_read(void) { return sim_ms; }
+uint16_t timer_elapsed(uint16_t last) { return sim_ms - last; }
+
+/* keymap: keycode tells layer, row and col */
+uint8_t keymap_get_keycode(uint8_t layer, uint8_t row, uint8_t col)
+{
+    return 0x04 + layer * 16 + row * 4 + col;
+}
+
+static uint8_t cache_cleared = 0;
+void layer_clear_cache(void) { cache_cleared++; }
+
+
+static void run(uint16_t ms)
+{
+    while (ms--) {
+        keymap_overlay_task();
+        eeprom_busy = false;
+        sim_ms++;
+    }
+}
+
+static void reboot(void)
+{
+    memset(&image, 0, sizeof(image));
+    memset(marked, 0, sizeof(marked));
+    dirty = false;
+    keymap_overlay_init();
+}
+
+
+int main(void)
+{
+    debug_enable = true;
+
+    // layout fits default range 0x20-0x61
+    CHECK_EQ(KEYMAP_OVERLAY_EEPROM_ADDR, 0x20);
+    CHECK_EQ(IMAGE_SIZE, 66);
+    CHECK_EQ(sizeof(image), IMAGE_SIZE);
+
+    // erased EEPROM: no override, nothing written
+    memset(eeprom, 0xFF, sizeof(eeprom));
+    keymap_overlay_init();
+    CHECK_EQ(keymap_overlay_count, 0);
+    CHECK_EQ(keymap_overlay_get_keycode(0, 1, 2), keymap_get_keycode(0, 1, 2));
+    run(5000);
+    CHECK_EQ(writes_total(), 0);
+
+    // remap: effective at once, cache dropped
+    cache_cleared = 0;
+    CHECK(keymap_overlay_set(0, 1, 2, 0x50));
+    CHECK(keymap_overlay_set(1, 3, 3, 0x51));
+    CHECK_EQ(keymap_overlay_count, 2);
+    CHECK_EQ(cache_cleared, 2);
+    CHECK_EQ(keymap_overlay_get_keycode(0, 1, 2), 0x50);
+    CHECK_EQ(keymap_overlay_get_keycode(1, 3, 3), 0x51);
+    // same key on other layer is not affected
+    CHECK_EQ(keymap_overlay_get_keycode(1, 1, 2), keymap_get_keycode(1, 1, 2));
+
+    // written after WRITE_DELAY from last edit, one byte per scan
+    run(KEYMAP_OVERLAY_WRITE_DELAY - 10);
+    CHECK(keymap_overlay_set(0, 0, 0, 0x52));
+    run(KEYMAP_OVERLAY_WRITE_DELAY - 10);
+    CHECK_EQ(writes_total(), 0);
+    run(11);
+    CHECK_EQ(writes_total(), 1);
+    run(100);
+    CHECK(!dirty);
+    CHECK(test_log_has("remap: saved"));
+    CHECK_EQ(writes_total(), 2 + 3 * 4);
+    CHECK_EQ(keymap_overlay_writes, 2 + 3 * 4);
+    CHECK_EQ(writes_outside(), 0);
+    CHECK_EQ(eeprom[0x20], 0x4B);
+    CHECK_EQ(eeprom[0x21], 3);
+    CHECK_EQ(eeprom[0x1F], 0xFF);
+    CHECK_EQ(eeprom[0x20 + 2 + 3 * 4], 0xFF);
+
+    // loaded after reboot
+    reboot();
+    CHECK_EQ(keymap_overlay_count, 3);
+    CHECK_EQ(keymap_overlay_get_keycode(0, 1, 2), 0x50);
+    CHECK_EQ(keymap_overlay_get_keycode(1, 3, 3), 0x51);
+    CHECK_EQ(keymap_overlay_get_keycode(0, 0, 0), 0x52);
+    CHECK_EQ(keymap_overlay_get_keycode(0, 3, 3), keymap_get_keycode(0, 3, 3));
+
+    // change of a keycode writes only that byte
+    memset(eeprom_written, 0, sizeof(eeprom_written));
+    CHECK(keymap_overlay_set(0, 1, 2, 0x53));
+    run(KEYMAP_OVERLAY_WRITE_DELAY + 100);
+    CHECK_EQ(writes_total(), 1);
+
+    // set back to same keycode in batch: nothing to write
+    memset(eeprom_written, 0, sizeof(eeprom_written));
+    CHECK(keymap_overlay_set(0, 1, 2, 0x54));
+    CHECK(keymap_overlay_set(0, 1, 2, 0x53));
+    run(KEYMAP_OVERLAY_WRITE_DELAY + 100);
+    CHECK_EQ(writes_total(), 0);
+    CHECK(!dirty);
+
+    // keycode of keymap removes override
+    CHECK(keymap_overlay_set(0, 1, 2, keymap_get_keycode(0, 1, 2)));
+    CHECK_EQ(keymap_overlay_count, 2);
+    CHECK_EQ(keymap_overlay_get_keycode(0, 1, 2), keymap_get_keycode(0, 1, 2));
+    run(KEYMAP_OVERLAY_WRITE_DELAY + 100);
+    reboot();
+    CHECK_EQ(keymap_overlay_count, 2);
+    CHECK_EQ(keymap_overlay_get_keycode(0, 1, 2), keymap_get_keycode(0, 1, 2));
+    CHECK_EQ(keymap_overlay_get_keycode(1, 3, 3), 0x51);
+    CHECK_EQ(keymap_overlay_get_keycode(0, 0, 0), 0x52);
+
+    // full
+    keymap_overlay_clear();
+    for (uint8_t i = 0; i < KEYMAP_OVERLAY_SIZE; i++) {
+        CHECK(keymap_overlay_set(i / 16, (i / 4) % 4, i % 4, 0x60 + i));
+    }
+    CHECK(!keymap_overlay_set(1, 0, 0, 0x70));
+    CHECK_EQ(keymap_overlay_count, KEYMAP_OVERLAY_SIZE);
+    run(KEYMAP_OVERLAY_WRITE_DELAY + 100);
+    CHECK_EQ(writes_outside(), 0);
+    reboot();
+    CHECK_EQ(keymap_overlay_count, KEYMAP_OVERLAY_SIZE);
+    CHECK_EQ(keymap_overlay_get_keycode(0, 3, 3), 0x6F);
+
+    // clear
+    keymap_overlay_clear();
+    run(KEYMAP_OVERLAY_WRITE_DELAY + 100);
+    reboot();
+    CHECK_EQ(keymap_overlay_count, 0);
+    CHECK_EQ(keymap_overlay_get_keycode(0, 3, 3), keymap_get_keycode(0, 3, 3));
+
+    // EEPROM written while busy is waited for
+    keymap_overlay_set(0, 2, 2, 0x55);
+    run(KEYMAP_OVERLAY_WRITE_DELAY);
+    eeprom_busy = true;
+    keymap_overlay_task();
+    keymap_overlay_task();
+    eeprom_busy = false;
+    run(100);
+    reboot();
+    CHECK_EQ(keymap_overlay_get_keycode(0, 2, 2), 0x55);
+
+    // broken image: no override
+    eeprom[0x20] = 0x00;
+    reboot();
+    CHECK_EQ(keymap_overlay_count, 0);
+    eeprom[0x20] = 0x4B;
+    eeprom[0x21] = KEYMAP_OVERLAY_SIZE + 1;
+    reboot();
+    CHECK_EQ(keymap_overlay_count, 0);
+    CHECK_EQ(keymap_overlay_get_keycode(0, 2, 2), keymap_get_keycode(0, 2, 2));
+
+    // count written before erased keys: out of matrix, not loaded
+    eeprom[0x21] = 2;
+    memset(eeprom + 0x22, 0xFF, 8);
+    eeprom[0x22] = 0; eeprom[0x23] = 1; eeprom[0x24] = 1; eeprom[0x25] = 0x50;
+    reboot();
+    CHECK_EQ(keymap_overlay_count, 0);
+    CHECK_EQ(marked[3], 0);
+    CHECK_EQ(keymap_overlay_get_keycode(0, 1, 1), keymap_get_keycode(0, 1, 1));
+    // keycode and layer out of range
+    memset(eeprom + 0x26, 0, 3);
+    eeprom[0x29] = 0xFF;
+    reboot();
+    CHECK_EQ(keymap_overlay_count, 0);
+    eeprom[0x26] = 8;
+    eeprom[0x29] = 0x51;
+    reboot();
+    CHECK_EQ(keymap_overlay_count, 0);
+    eeprom[0x26] = 7;
+    reboot();
+    CHECK_EQ(keymap_overlay_count, 2);
+
+    // power lost in flush: keys are written before count, either old or
+    // new image is loaded
+    keymap_overlay_clear();
+    run(KEYMAP_OVERLAY_WRITE_DELAY + 100);
+    for (uint8_t n = 1; n < 2 + 3 * 4; n++) {
+        keymap_overlay_clear();
+        run(KEYMAP_OVERLAY_WRITE_DELAY + 100);
+        memset(eeprom + 0x22, 0xFF, 3 * 4);
+        CHECK(keymap_overlay_set(0, 1, 1, 0x56));
+        CHECK(keymap_overlay_set(0, 2, 3, 0x57));
+        CHECK(keymap_overlay_set(1, 3, 0, 0x58));
+        run(KEYMAP_OVERLAY_WRITE_DELAY);
+        memset(eeprom_written, 0, sizeof(eeprom_written));
+        while (writes_total() < n) run(1);
+        reboot();
+        if (keymap_overlay_count == 0) {
+            CHECK_EQ(keymap_overlay_get_keycode(0, 1, 1), keymap_get_keycode(0, 1, 1));
+        } else {
+            CHECK_EQ(n, 3 * 4 + 1);
+            CHECK_EQ(keymap_overlay_count, 3);
+            CHECK_EQ(keymap_overlay_get_keycode(1, 3, 0), 0x58);
+        }
+    }
+
+    // edit: key to change, then key to copy
+    keymap_overlay_clear();
+    keymap_overlay_edit(1);
+    CHECK(keymap_overlay_editing());
+    CHECK(keymap_overlay_key_event(0, 1, true));
+    CHECK(!keymap_overlay_key_event(0, 1, false));
+    CHECK(keymap_overlay_key_event(2, 3, true));
+    CHECK(!keymap_overlay_editing());
+    CHECK_EQ(keymap_overlay_get_keycode(1, 0, 1), keymap_get_keycode(1, 2, 3));
+    CHECK(!keymap_overlay_key_event(2, 3, true));
+
+    // edit: same key twice restores keymap
+    keymap_overlay_edit(1);
+    keymap_overlay_key_event(0, 1, true);
+    keymap_overlay_key_event(0, 1, true);
+    CHECK_EQ(keymap_overlay_get_keycode(1, 0, 1), keymap_get_keycode(1, 0, 1));
+    CHECK_EQ(keymap_overlay_count, 0);
+
+    // edit: canceled after timeout
+    test_log_clear();
+    keymap_overlay_edit(0);
+    run(KEYMAP_OVERLAY_EDIT_TIMEOUT + 2);
+    CHECK(!keymap_overlay_editing());
+    CHECK(test_log_has("remap: canceled"));
+
+    CHECK_EQ(writes_outside(), 0);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,314 @@
+/*
+ * layer.c: Fn key cases in layer.c header comment and fast rolls
+ *
+ * scan() does what keyboard_proc() does with key events and report every
+ * 1ms. Each report which differs from the previous one is logged as its
+ * keys, '_' for Fn keycode(Space), '-' for empty report.
+ */
+#include "test.h"
+
+#define MATRIX_ROWS 2
+#define MATRIX_COLS 5
+#define LAYER_DEFER_SIZE 4
+
+#include "layer.c"
+#include "util.c"
+
+
+/* keymap: Fn0 switches to layer 1 and sends Space on tap, Fn1 switches to
+ * layer 2 and has no keycode */
+static const uint8_t keymaps[3][MATRIX_ROWS][MATRIX_COLS] = {
+    { { KB_FN0,  KB_A,     KB_B,    KB_C,    KB_FN1 },
+      { KB_G,    KB_D,     KB_E,    KB_F,    KB_H } },
+    { { KB_TRNS, KB_LEFT,  KB_TRNS, KB_TRNS, KB_TRNS },
+      { KB_TRNS, KB_TRNS,  KB_TRNS, KB_TRNS, KB_TRNS } },
+    { { KB_TRNS, KB_RIGHT, KB_TRNS, KB_TRNS, KB_TRNS },
+      { KB_TRNS, KB_TRNS,  KB_TRNS, KB_TRNS, KB_TRNS } },
+};
+uint8_t keymap_get_keycode(uint8_t layer, uint8_t row, uint8_t col)
+{
+    return keymaps[layer][row][col];
+}
+uint8_t keymap_fn_layer(uint8_t fn_bits)
+{
+    return (fn_bits == FN_BIT(KB_FN0)) ? 1 : (fn_bits == FN_BIT(KB_FN1)) ? 2 : 0;
+}
+uint8_t keymap_fn_keycode(uint8_t fn_bits)
+{
+    return (fn_bits == FN_BIT(KB_FN0)) ? KB_SPC : KB_NO;
+}
+
+
+/* host */
+static char report[16];
+static char last_report[16] = "-";
+static char history[256];
+
+static char key_char(uint8_t code)
+{
+    switch (code) {
+        case KB_SPC:  return '_';
+        case KB_LEFT: return '<';
+        case KB_RIGHT: return '>';
+        default:      return 'A' + (code - KB_A);
+    }
+}
+void host_add_code(uint8_t code)
+{
+    size_t n = strlen(report);
+    report[n] = key_char(code);
+    report[n + 1] = '\0';
+}
+uint8_t host_has_anykey(void)
+{
+    return strcmp(last_report, "-") != 0;
+}
+
+
+/* keyboard */
+static uint8_t keys[MATRIX_ROWS];
+static uint8_t last_keys[MATRIX_ROWS];
+static uint16_t now = 0;
+
+static void scan(void)
+{
+    layer_task(now);
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+        for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+            bool on = keys[row] & (1<<col);
+            if (on != (bool)(last_keys[row] & (1<<col))) {
+                layer_key_event(row, col, on, now);
+                last_keys[row] ^= (1<<col);
+            }
+        }
+    }
+
+    report[0] = '\0';
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+        for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+            if (!(keys[row] & (1<<col))) continue;
+            if (layer_key_is_deferred(row, col)) continue;
+            uint8_t code = layer_get_keycode(row, col);
+            if (IS_KEY(code)) host_add_code(code);
+        }
+    }
+    layer_report();
+    if (!report[0]) strcpy(report, "-");
+
+    if (strcmp(report, last_report)) {
+        strcat(history, report);
+        strcat(history, "|");
+        strcpy(last_report, report);
+    }
+    now++;
+}
+
+static void run(uint16_t ms)
+{
+    while (ms--) scan();
+}
+
+static void press(uint8_t row, uint8_t col)   { keys[row] |=  (1<<col); }
+static void release(uint8_t row, uint8_t col) { keys[row] &= ~(1<<col); }
+
+#define FN      0, 0
+#define A       0, 1
+#define B       0, 2
+#define C       0, 3
+#define FN1     0, 4
+#define G       1, 0
+#define D       1, 1
+
+static void start(void)
+{
+    run(1000);      // forget last tap
+    history[0] = '\0';
+    test_log_clear();
+}
+
+#define CHECK_HISTORY(s) do { \
+    if (strcmp(history, s)) { \
+        printf("%s:%d: history \"%s\", expected \"%s\"\n", __FILE__, __LINE__, history, s); \
+        test_failures++; \
+    } \
+} while (0)
+
+
+int main(void)
+{
+    debug_enable = true;
+
+    // 1. release Fn after SEND_FN_TERM: layer only
+    start();
+    press(FN);
+    run(LAYER_SWITCH_DELAY);
+    CHECK_EQ(layer_state, 0x01);
+    run(2);
+    CHECK_EQ(layer_state, 0x03);
+    run(LAYER_SEND_FN_TERM);
+    release(FN);
+    run(10);
+    CHECK_HISTORY("");
+    CHECK_EQ(layer_state, 0x01);
+
+    // 2. release Fn during SEND_FN_TERM, layer not used: one shot Fn key
+    start();
+    press(FN);
+    run(300);
+    CHECK_EQ(layer_state, 0x03);
+    release(FN);
+    run(10);
+    CHECK_HISTORY("_|-|");
+    CHECK_EQ(layer_state, 0x01);
+
+    // 3. release Fn during SEND_FN_TERM, layer used: no Fn key
+    start();
+    press(FN);
+    run(200);
+    press(A);
+    run(20);
+    release(A);
+    run(20);
+    release(FN);
+    run(10);
+    CHECK_HISTORY("<|-|");
+    CHECK_EQ(layer_state, 0x01);
+
+    // 4. other key during SWITCH_DELAY: Fn key goes first, no layer
+    start();
+    press(FN);
+    run(50);
+    press(B);
+    run(20);
+    CHECK(test_log_has("Fn case: 4"));
+    release(B);
+    run(200);
+    CHECK_EQ(layer_state, 0x01);
+    release(FN);
+    run(10);
+    CHECK_HISTORY("_|B_|_|-|");
+
+    // 5. Fn while other key is down: Fn key at once, no layer
+    start();
+    press(A);
+    run(20);
+    press(FN);
+    run(300);
+    CHECK_EQ(layer_state, 0x01);
+    release(FN);
+    run(10);
+    release(A);
+    run(10);
+    CHECK_HISTORY("A|A_|A|-|");
+
+    // 6. Fn twice quickly and hold: repeat Fn key, no layer
+    start();
+    press(FN);
+    run(50);
+    release(FN);
+    run(50);
+    press(FN);
+    run(600);
+    CHECK_EQ(layer_state, 0x01);
+    release(FN);
+    run(10);
+    CHECK_HISTORY("_|-|_|-|");
+
+    // roll: Fn, A, release Fn, release A
+    start();
+    press(FN);
+    run(20);
+    press(A);
+    run(20);
+    release(FN);
+    run(20);
+    release(A);
+    run(10);
+    CHECK_HISTORY("_|A_|A|-|");
+
+    // roll: A, Fn, release A, release Fn
+    start();
+    press(A);
+    run(20);
+    press(FN);
+    run(20);
+    release(A);
+    run(20);
+    release(FN);
+    run(10);
+    CHECK_HISTORY("A|A_|_|-|");
+
+    // roll within one scan: all keys pressed with the first one wait
+    start();
+    press(FN);
+    run(30);
+    press(A); press(B); press(C);
+    run(10);
+    release(A); release(B); release(C); release(FN);
+    run(10);
+    CHECK_HISTORY("_|ABC_|-|");
+
+    // more keys in the scan than LAYER_DEFER_SIZE: rest go with Fn, logged
+    start();
+    press(FN);
+    run(30);
+    press(A); press(B); press(C); press(G); press(D);
+    run(10);
+    release(A); release(B); release(C); release(G); release(D); release(FN);
+    run(10);
+    CHECK_HISTORY("D_|ABCGD_|-|");
+    CHECK(test_log_has("defer full"));
+
+    // roll: Fn pressed in the scan A is released counts as case 5
+    start();
+    press(A);
+    run(5);
+    release(A);
+    press(FN);
+    run(5);
+    press(B);
+    run(5);
+    release(FN);
+    run(5);
+    release(B);
+    run(10);
+    CHECK_HISTORY("A|_|B_|B|-|");
+
+    // Fn without keycode: layer at once, no LAYER_SWITCH_DELAY
+    start();
+    press(FN1);
+    run(1);
+    CHECK_EQ(layer_state, 0x05);
+    press(A);
+    run(20);
+    release(A);
+    run(20);
+    release(FN1);
+    run(10);
+    CHECK_HISTORY(">|-|");
+    CHECK_EQ(layer_state, 0x01);
+
+    // Fn without keycode tapped: nothing sent
+    start();
+    press(FN1);
+    run(50);
+    release(FN1);
+    run(10);
+    CHECK_HISTORY("");
+    CHECK_EQ(layer_state, 0x01);
+
+    // Fn without keycode with other key down: still layer
+    start();
+    press(B);
+    run(20);
+    press(FN1);
+    run(1);
+    CHECK_EQ(layer_state, 0x05);
+    press(A);
+    run(20);
+    release(A); release(B); release(FN1);
+    run(10);
+    CHECK_HISTORY("B|>B|-|");
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,220 @@
+/*
+ * layer.c: cost of keycode lookup with LAYER_CACHE_ENABLE on and off, and
+ * per-scan cost with all 8 layers active
+ *
+ * Cost is counted as keymap reads, each a keymap_get_keycode() with
+ * pgm_read_byte() on AVR, and host time is printed for reference. Without
+ * cache every lookup reads keymap; with cache lookup is index into RAM and
+ * keymap is read only at first lookup of a key after layer_state changes.
+ */
+#include <time.h>
+#include "test.h"
+
+#define MATRIX_ROWS 8
+#define MATRIX_COLS 8
+#define RAMEND 0xAFF        // ATmega32U4
+#define LAYER_CACHE_ENABLE
+
+#include "layer.c"
+#include "util.c"
+
+
+/*
+ * keymap: layer n(>0) changes only key (0, n), rest are transparent.
+ * Fn0-Fn6 on row 7 switch to layer 1-7, modifiers on row 6.
+ */
+static uint8_t keymaps[8][MATRIX_ROWS][MATRIX_COLS];
+static uint32_t reads = 0;
+
+uint8_t keymap_get_keycode(uint8_t layer, uint8_t row, uint8_t col)
+{
+    reads++;
+    return keymaps[layer][row][col];
+}
+uint8_t keymap_fn_layer(uint8_t fn_bits) { return biton(fn_bits) + 1; }
+uint8_t keymap_fn_keycode(uint8_t fn_bits) { return KB_NO; }
+void host_add_code(uint8_t code) { }
+uint8_t host_has_anykey(void) { return 0; }
+
+static void keymap_init(void)
+{
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+        for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+            if (row == 6)
+                keymaps[0][row][col] = KB_LCTRL + col;
+            else if (row == 7 && col < 7)
+                keymaps[0][row][col] = KB_FN0 + col;
+            else
+                keymaps[0][row][col] = KB_A + (row * MATRIX_COLS + col) % 26;
+            for (uint8_t layer = 1; layer < 8; layer++) {
+                keymaps[layer][row][col] = KB_TRNS;
+            }
+        }
+    }
+    for (uint8_t layer = 1; layer < 8; layer++) {
+        keymaps[layer][0][layer] = KB_F1 + layer - 1;
+    }
+}
+
+
+/* keys held down in each scan */
+#define SCANS   1000
+#define HELD    6
+static const struct { uint8_t row, col; } held[HELD] = {
+    { 1, 1 }, { 2, 3 }, { 3, 5 }, { 4, 7 }, { 5, 0 }, { 5, 2 },
+};
+
+static uint8_t lookup(bool cached, uint8_t row, uint8_t col)
+{
+    if (cached) return layer_get_keycode(row, col);
+    // layer_get_keycode() without cache
+    return resolve_keycode(layer_state, row, col);
+}
+
+/* keymap reads in SCANS, layer_state is 'state' in every other 'every' scans */
+static uint32_t bench(bool cached, uint8_t state, uint16_t every)
+{
+    struct timespec t0, t1;
+
+    set_layer_state(1<<0);
+    layer_clear_cache();
+    reads = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (uint16_t scan = 0; scan < SCANS; scan++) {
+        set_layer_state((every && (scan / every) % 2) ? state : 1<<0);
+        for (uint8_t i = 0; i < HELD; i++) {
+            lookup(cached, held[i].row, held[i].col);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+    printf("  cache %-3s layer_state %02X every %4u: %6u reads %6.1f ns/lookup\n",
+           cached ? "on" : "off", state, every, reads, ns / (SCANS * HELD));
+    return reads;
+}
+
+
+/*
+ * Per-scan budget: keymap reads of a scan take less than 1ms at 16MHz,
+ * interval of the fastest keyboard report. A read is taken as 64 cycles on
+ * AVR: keymap_get_keycode() call with pgm_read_byte() and a step of search
+ * in resolve_keycode() including shift of the layer bit.
+ */
+#define BUDGET_CYCLES   16000
+#define READ_CYCLES     64
+
+static uint8_t keys[MATRIX_ROWS];
+static uint8_t last_keys[MATRIX_ROWS];
+static uint16_t now = 0;
+
+/* keymap reads of a scan, key events and report as keyboard_proc() does */
+static uint32_t scan(bool cached)
+{
+    reads = 0;
+    layer_task(now);
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+        for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+            bool on = keys[row] & (1<<col);
+            if (on != (bool)(last_keys[row] & (1<<col))) {
+                // lookup in event without cache
+                if (!cached) layer_clear_cache();
+                layer_key_event(row, col, on, now);
+                last_keys[row] ^= (1<<col);
+            }
+        }
+    }
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+        for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+            if (!(keys[row] & (1<<col))) continue;
+            if (layer_key_is_deferred(row, col)) continue;
+            lookup(cached, row, col);
+        }
+    }
+    now++;
+    return reads;
+}
+
+/* most keymap reads in a scan: Fn0-Fn6, 6 keys and 8 modifiers at once */
+static uint32_t bench_layers(bool cached, uint32_t *steady)
+{
+    uint32_t most = 0, r = 0;
+    struct timespec t0, t1;
+
+    set_layer_state(1<<0);
+    layer_clear_cache();
+    keys[7] = 0x7F;
+    keys[6] = 0xFF;
+    for (uint8_t i = 0; i < HELD; i++) keys[held[i].row] |= 1<<held[i].col;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (uint16_t i = 0; i < SCANS; i++) {
+        if ((r = scan(cached)) > most) most = r;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    *steady = r;
+    CHECK_EQ(layer_state, 0xFF);
+    memset(keys, 0, sizeof(keys));
+    scan(cached);
+    CHECK_EQ(layer_state, 1<<0);
+
+    double ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+    printf("  cache %-3s 8 layers, 21 keys: %3u reads/scan most, %3u steady, %6.1f us/scan\n",
+           cached ? "on" : "off", most, *steady, ns / 1000 / SCANS);
+    return most;
+}
+
+
+int main(void)
+{
+    keymap_init();
+
+    // same keycode with and without cache for every set of active layers
+    for (uint16_t state = 1; state < 0x100; state += 2) {
+        set_layer_state(state);
+        for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+            for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+                CHECK_EQ(layer_get_keycode(row, col), resolve_keycode(state, row, col));
+            }
+        }
+    }
+
+    // cache is loaded again when layer_state changes
+    set_layer_state(1<<0);
+    CHECK_EQ(layer_get_keycode(0, 1), KB_B);
+    set_layer_state(1<<0 | 1<<1);
+    CHECK_EQ(layer_get_keycode(0, 1), KB_F1);
+    set_layer_state(1<<0);
+    CHECK_EQ(layer_get_keycode(0, 1), KB_B);
+
+    // and after keymap change
+    keymaps[0][0][1] = KB_Z;
+    CHECK_EQ(layer_get_keycode(0, 1), KB_B);
+    layer_clear_cache();
+    CHECK_EQ(layer_get_keycode(0, 1), KB_Z);
+    keymap_init();
+
+    printf("%u scans with %u keys held, %ux%u matrix\n", SCANS, HELD, MATRIX_ROWS, MATRIX_COLS);
+
+    // base layer only: a read per lookup, or per key held
+    CHECK_EQ(bench(false, 1<<0, 0), SCANS * HELD);
+    CHECK_EQ(bench(true, 1<<0, 0), HELD);
+
+    // Fn layer held: held keys are transparent on it
+    CHECK_EQ(bench(false, 1<<0 | 1<<1, 1), SCANS * HELD * 3 / 2);
+    CHECK(bench(true, 1<<0 | 1<<1, 100) < bench(false, 1<<0 | 1<<1, 100));
+
+    // layer changing every scan: cache loads cost no more than without
+    CHECK_EQ(bench(true, 1<<0 | 1<<1, 1), bench(false, 1<<0 | 1<<1, 1));
+
+    // 8 layers active: a key reads each layer down to base at most
+    uint32_t steady;
+    uint32_t most = bench_layers(false, &steady);
+    CHECK_EQ(steady, 21 * 8);
+    CHECK(most * READ_CYCLES < BUDGET_CYCLES);
+    printf("  budget: %u of %u cycles at most\n", most * READ_CYCLES, BUDGET_CYCLES);
+    most = bench_layers(true, &steady);
+    CHECK_EQ(steady, 0);
+    CHECK(most * READ_CYCLES < BUDGET_CYCLES);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,204 @@
+/*
+ * ps2_led.c against simulated keyboard
+ *
+ * ps2_host_send_async() and response polling are replaced with a keyboard
+ * model which answers each byte after 1ms, as scripted per test. The task
+ * is called once per simulated millisecond like from matrix_scan().
+ */
+#include "test.h"
+
+#define PS2_CLOCK_PORT  0
+#define PS2_CLOCK_PIN   0
+#define PS2_CLOCK_DDR   0
+#define PS2_CLOCK_BIT   0
+#define PS2_DATA_PORT   0
+#define PS2_DATA_PIN    0
+#define PS2_DATA_DDR    0
+#define PS2_DATA_BIT    0
+
+#include "ps2_led.c"
+
+
+/* timer */
+static uint16_t sim_ms = 0;
+uint16_t timer_read(void) { return sim_ms; }
+uint16_t timer_elapsed(uint16_t last) { return sim_ms - last; }
+
+/* keyboard: reply to each byte, ACK when script is exhausted */
+#define NO_CLOCK    0x100   // send fails
+#define SILENT      0       // byte taken, no response
+static uint16_t script[16];
+static uint8_t script_len, script_pos;
+static uint8_t sent[16];
+static uint8_t sent_len;
+static uint8_t keyboard_led = 0;
+static bool keyboard_wait_data = false;
+static uint8_t response = 0;
+static uint16_t response_time;
+static bool outstanding = false;
+
+bool ps2_host_send_async(uint8_t data)
+{
+    // one command at a time
+    CHECK(!outstanding);
+    uint16_t reply = script_pos < script_len ? script[script_pos++] : PS2_ACK;
+    if (reply == NO_CLOCK) return false;
+    if (sent_len < sizeof(sent)) sent[sent_len++] = data;
+    if (reply == PS2_ACK) {
+        // command byte aborts waiting for LED data
+        if (data == PS2_SET_LED) {
+            keyboard_wait_data = true;
+        } else if (keyboard_wait_data) {
+            keyboard_led = data;
+            keyboard_wait_data = false;
+        }
+    }
+    response = reply;
+    response_time = sim_ms + 1;
+    outstanding = true;
+    return true;
+}
+
+uint8_t ps2_host_poll_response(void)
+{
+    if (!outstanding || !response || sim_ms < response_time) return 0;
+    outstanding = false;
+    return response;
+}
+
+void ps2_host_cancel_response(void)
+{
+    outstanding = false;
+}
+
+static void reset(void)
+{
+    script_len = script_pos = 0;
+    sent_len = 0;
+    ps2_led_coalesced = 0;
+}
+
+static void run(uint16_t ms)
+{
+    while (ms--) {
+        ps2_host_led_task();
+        sim_ms++;
+    }
+}
+
+#define CHECK_SENT(...) do { \
+    uint8_t _e[] = { __VA_ARGS__ }; \
+    CHECK_EQ(sent_len, sizeof(_e)); \
+    CHECK(sent_len == sizeof(_e) && !memcmp(sent, _e, sizeof(_e))); \
+} while (0)
+
+
+int main(void)
+{
+    debug_enable = true;
+
+    // update
+    reset();
+    ps2_host_set_led_async(0x04);
+    CHECK(!ps2_host_led_busy());
+    run(1);
+    CHECK(ps2_host_led_busy());
+    run(10);
+    CHECK(!ps2_host_led_busy());
+    CHECK_SENT(PS2_SET_LED, 0x04);
+    CHECK_EQ(keyboard_led, 0x04);
+    CHECK_EQ(state, LED_IDLE);
+    CHECK(!pending);
+
+    // requests before task runs: only the latest is sent
+    reset();
+    ps2_host_set_led_async(0x01);
+    ps2_host_set_led_async(0x02);
+    ps2_host_set_led_async(0x03);
+    run(10);
+    CHECK_SENT(PS2_SET_LED, 0x03);
+    CHECK_EQ(keyboard_led, 0x03);
+    CHECK_EQ(ps2_led_coalesced, 2);
+
+    // request while 0xED waits for ack replaces LED data
+    reset();
+    ps2_host_set_led_async(0x01);
+    run(1);
+    ps2_host_set_led_async(0x02);
+    run(10);
+    CHECK_SENT(PS2_SET_LED, 0x02);
+    CHECK_EQ(keyboard_led, 0x02);
+    CHECK_EQ(ps2_led_coalesced, 1);
+
+    // request while LED data waits for ack is sent after it
+    reset();
+    ps2_host_set_led_async(0x01);
+    run(2);
+    CHECK_EQ(state, LED_WAIT_DATA);
+    ps2_host_set_led_async(0x04);
+    run(10);
+    CHECK_SENT(PS2_SET_LED, 0x01, PS2_SET_LED, 0x04);
+    CHECK_EQ(keyboard_led, 0x04);
+    CHECK_EQ(ps2_led_coalesced, 0);
+
+    // resend requested: retried
+    reset();
+    script[0] = PS2_RESEND; script[1] = PS2_RESEND;
+    script_len = 2;
+    ps2_host_set_led_async(0x02);
+    run(20);
+    CHECK_SENT(PS2_SET_LED, PS2_SET_LED, PS2_SET_LED, 0x02);
+    CHECK_EQ(keyboard_led, 0x02);
+
+    // LED data not acked: start over from 0xED
+    reset();
+    script[0] = PS2_ACK; script[1] = PS2_RESEND;
+    script_len = 2;
+    ps2_host_set_led_async(0x05);
+    run(20);
+    CHECK_SENT(PS2_SET_LED, 0x05, PS2_SET_LED, 0x05);
+    CHECK_EQ(keyboard_led, 0x05);
+
+    // keyboard keeps refusing: dropped after three tries
+    reset();
+    for (uint8_t i = 0; i < 8; i++) script[i] = PS2_RESEND;
+    script_len = 8;
+    ps2_host_set_led_async(0x01);
+    run(100);
+    CHECK_SENT(PS2_SET_LED, PS2_SET_LED, PS2_SET_LED);
+    CHECK(!pending);
+    CHECK_EQ(state, LED_IDLE);
+
+    // keyboard takes byte but never answers: each try times out
+    reset();
+    for (uint8_t i = 0; i < 8; i++) script[i] = SILENT;
+    script_len = 8;
+    ps2_host_set_led_async(0x01);
+    run(PS2_RESPONSE_TIMEOUT);
+    CHECK_SENT(PS2_SET_LED);
+    run(3 * (PS2_RESPONSE_TIMEOUT + 2));
+    CHECK_SENT(PS2_SET_LED, PS2_SET_LED, PS2_SET_LED);
+    CHECK(!pending);
+    CHECK(!outstanding);
+    CHECK(test_log_has("LED: failed"));
+
+    // keyboard unplugged: send fails at once, dropped after three tries
+    reset();
+    for (uint8_t i = 0; i < 8; i++) script[i] = NO_CLOCK;
+    script_len = 8;
+    ps2_host_set_led_async(0x01);
+    run(3);
+    CHECK_EQ(script_pos, 3);
+    CHECK(!pending);
+    run(10);
+    CHECK_EQ(script_pos, 3);
+
+    // next request after drop still works
+    reset();
+    ps2_host_set_led_async(0x07);
+    run(10);
+    CHECK_SENT(PS2_SET_LED, 0x07);
+    CHECK_EQ(keyboard_led, 0x07);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,242 @@
+/*
+ * ps2_mouse.c: middle button scroll over trackpoint packet streams
+ *
+ * Streams are packets of 3 bytes as ps2_mouse_read() reads them from
+ * trackpoint in remote mode: button/sign/overflow, X and Y. They are given
+ * to ps2_mouse_usb_send() one per scan of 10ms and reports and wheel
+ * amounts sent are summed up.
+ *
+ * Random packets with full 9-bit movement and overflow check that total
+ * displacement is kept across reports of -127/127.
+ */
+#include "test.h"
+
+#define PS2_CLOCK_PORT  0
+#define PS2_CLOCK_PIN   0
+#define PS2_CLOCK_DDR   0
+#define PS2_CLOCK_BIT   0
+#define PS2_DATA_PORT   0
+#define PS2_DATA_PIN    0
+#define PS2_DATA_DDR    0
+#define PS2_DATA_BIT    0
+
+#include "ps2_mouse.c"
+
+
+uint8_t ps2_error = PS2_ERR_NONE;
+void ps2_host_init(void) { }
+uint8_t ps2_host_send(uint8_t data) { return 0; }
+uint8_t ps2_host_recv(void) { return 0; }
+
+/* timer */
+static uint16_t sim_ms = 0;
+uint16_t timer_read(void) { return sim_ms; }
+uint16_t timer_elapsed(uint16_t last) { return sim_ms - last; }
+void _delay_ms(double ms) { }
+
+/* host */
+static int32_t sum_x, sum_y, sum_v, sum_h;
+static uint16_t reports;
+static uint8_t buttons;             // last report
+static uint8_t buttons_seen;        // in any report
+static uint16_t middle_ms;          // time middle button is on
+static bool out_of_range;           // -128 in report
+
+void host_mouse_send(report_mouse_t *report)
+{
+    sum_x += report->x;
+    sum_y += report->y;
+    if (report->x == -128 || report->y == -128) out_of_range = true;
+    reports++;
+    buttons = report->buttons;
+    buttons_seen |= report->buttons;
+}
+void host_wheel_add(int16_t v, int16_t h)
+{
+    sum_v += v;
+    sum_h += h;
+}
+bool host_wheel_pending(void) { return false; }
+
+static void reset(void)
+{
+    sum_x = sum_y = sum_v = sum_h = 0;
+    reports = 0;
+    buttons_seen = 0;
+    middle_ms = 0;
+}
+
+static void packet(const uint8_t p[3])
+{
+    ps2_mouse_btn = p[0];
+    ps2_mouse_x = p[1];
+    ps2_mouse_y = p[2];
+    ps2_mouse_usb_send();
+    if (buttons & PS2_MOUSE_SCROLL_BUTTON) middle_ms += 10;
+    sim_ms += 10;
+}
+
+#define PLAY(stream) do { \
+    for (uint16_t i = 0; i < sizeof(stream) / 3; i++) packet(stream[i]); \
+} while (0)
+
+/* no button, no movement */
+static void idle(uint16_t n)
+{
+    static const uint8_t p[3] = { 0x08, 0x00, 0x00 };
+    while (n--) packet(p);
+}
+
+
+/* pointer move right and down */
+static const uint8_t move[][3] = {
+    { 0x08, 0x02, 0x00 }, { 0x28, 0x05, 0xFF }, { 0x28, 0x0C, 0xFD },
+    { 0x28, 0x14, 0xFA }, { 0x28, 0x0E, 0xFC }, { 0x08, 0x06, 0x00 },
+    { 0x08, 0x01, 0x00 },
+};
+
+/* middle click with jitter of finger on stick */
+static const uint8_t click[][3] = {
+    { 0x0C, 0x00, 0x00 }, { 0x0C, 0x01, 0x00 }, { 0x2C, 0x00, 0xFF },
+    { 0x1C, 0xFF, 0x01 }, { 0x0C, 0x00, 0x00 }, { 0x08, 0x00, 0x00 },
+};
+
+/* middle held, push up slowly: 2 counts per packet */
+static const uint8_t scroll_up[][3] = {
+    { 0x0C, 0x00, 0x01 }, { 0x0C, 0x00, 0x02 }, { 0x0C, 0x00, 0x02 },
+    { 0x0C, 0x00, 0x02 }, { 0x0C, 0x01, 0x02 }, { 0x0C, 0x00, 0x02 },
+    { 0x0C, 0x00, 0x02 }, { 0x1C, 0xFF, 0x02 }, { 0x0C, 0x00, 0x02 },
+    { 0x0C, 0x00, 0x02 }, { 0x0C, 0x00, 0x01 }, { 0x08, 0x00, 0x00 },
+};
+
+/* middle held, pull down fast */
+static const uint8_t scroll_down_fast[][3] = {
+    { 0x0C, 0x00, 0x00 }, { 0x2C, 0x00, 0xF8 }, { 0x2C, 0x00, 0xE0 },
+    { 0x2C, 0x00, 0xC0 }, { 0x2C, 0x00, 0xC0 }, { 0x2C, 0x00, 0xE8 },
+    { 0x08, 0x00, 0x00 },
+};
+
+/* middle held, push right */
+static const uint8_t scroll_right[][3] = {
+    { 0x0C, 0x03, 0x00 }, { 0x0C, 0x04, 0x00 }, { 0x0C, 0x04, 0x00 },
+    { 0x0C, 0x04, 0x00 }, { 0x08, 0x00, 0x00 },
+};
+
+/* drag with left button */
+static const uint8_t drag[][3] = {
+    { 0x09, 0x00, 0x00 }, { 0x09, 0x08, 0x00 }, { 0x09, 0x10, 0x00 },
+    { 0x19, 0xF0, 0x00 }, { 0x09, 0x00, 0x00 }, { 0x08, 0x00, 0x00 },
+};
+
+
+int main(void)
+{
+    // move: all movement, Y reversed, no wheel
+    reset();
+    PLAY(move);
+    CHECK_EQ(sum_x, 2 + 5 + 12 + 20 + 14 + 6 + 1);
+    CHECK_EQ(sum_y, 1 + 3 + 6 + 4);
+    CHECK_EQ(sum_v, 0);
+    CHECK_EQ(buttons_seen, 0);
+
+    // click: middle click for PS2_MOUSE_CLICK_TIME, jitter is not sent
+    reset();
+    PLAY(click);
+    idle(5);
+    CHECK_EQ(buttons_seen, PS2_MOUSE_SCROLL_BUTTON);
+    CHECK_EQ(buttons, 0);
+    CHECK(middle_ms >= PS2_MOUSE_CLICK_TIME);
+    CHECK(middle_ms <= PS2_MOUSE_CLICK_TIME + 10);
+    CHECK_EQ(sum_x, 0);
+    CHECK_EQ(sum_y, 0);
+    CHECK_EQ(sum_v, 0);
+    CHECK_EQ(scroll_state, SCROLL_OFF);
+
+    // slow scroll up: movement under threshold is scrolled too, no click
+    reset();
+    PLAY(scroll_up);
+    idle(5);
+    CHECK_EQ(sum_x, 0);
+    CHECK_EQ(sum_y, 0);
+    CHECK_EQ(buttons_seen, 0);
+    // first five packets reach threshold of 8 and start scroll with 9 up
+    CHECK_EQ(sum_v, scroll_amount(9) + 5 * scroll_amount(2) + scroll_amount(1));
+    CHECK_EQ(sum_h, scroll_amount(1) + scroll_amount(-1));
+    CHECK(sum_v >= (1 + 2 * 9 + 1) * 256 / PS2_MOUSE_SCROLL_DIVISOR);
+
+    // fast scroll down: accelerated
+    reset();
+    PLAY(scroll_down_fast);
+    idle(5);
+    CHECK_EQ(sum_y, 0);
+    CHECK_EQ(buttons_seen, 0);
+    CHECK(sum_v < 0);
+    CHECK(-sum_v > (8 + 32 + 64 + 64 + 24) * 256 / PS2_MOUSE_SCROLL_DIVISOR);
+
+    // horizontal scroll
+    reset();
+    PLAY(scroll_right);
+    idle(5);
+    CHECK_EQ(sum_x, 0);
+    CHECK_EQ(sum_v, 0);
+    CHECK_EQ(sum_h, scroll_amount(11) + scroll_amount(4));
+
+    // drag: left button with movement
+    reset();
+    PLAY(drag);
+    CHECK_EQ(buttons_seen, 1<<PS2_MOUSE_BTN_LEFT);
+    CHECK_EQ(buttons, 0);
+    CHECK_EQ(sum_x, 8 + 16 - 16);
+    CHECK_EQ(sum_v, 0);
+
+    // random 9-bit movement with overflow: total displacement is kept
+    reset();
+    int32_t total_x = 0, total_y = 0;
+    srand(1);
+    for (uint16_t i = 0; i < 1000; i++) {
+        int16_t x = rand() % 512 - 256;
+        int16_t y = rand() % 512 - 256;
+        uint8_t p[3] = { 0x08 | (x < 0 ? 0x10 : 0) | (y < 0 ? 0x20 : 0), x & 0xFF, y & 0xFF };
+        // overflowed axis counts as its maximum
+        if (i % 50 == 0) {
+            p[0] |= 0x40;
+            x = (x < 0 ? -256 : 255);
+        }
+        if (i % 70 == 0) {
+            p[0] |= 0x80;
+            y = (y < 0 ? -256 : 255);
+        }
+        total_x += x;
+        total_y -= y;
+        packet(p);
+    }
+    idle(1000);
+    CHECK_EQ(sum_x, total_x);
+    CHECK_EQ(sum_y, total_y);
+    CHECK(!out_of_range);
+    CHECK_EQ(motion_x, 0);
+    CHECK_EQ(motion_y, 0);
+
+    // flick of 255 in a packet: 127, 127 and 1 in following reports
+    reset();
+    static const uint8_t flick[3] = { 0x08, 0xFF, 0x00 };
+    packet(flick);
+    CHECK_EQ(sum_x, 127);
+    idle(1);
+    CHECK_EQ(sum_x, 254);
+    idle(1);
+    CHECK_EQ(sum_x, 255);
+    CHECK_EQ(reports, 3);
+    idle(5);
+    CHECK_EQ(reports, 3);
+
+    // scroll then click: each stream acts on its own
+    reset();
+    PLAY(scroll_up);
+    PLAY(click);
+    idle(5);
+    CHECK_EQ(buttons_seen, PS2_MOUSE_SCROLL_BUTTON);
+    CHECK(sum_v > 0);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,246 @@
+/*
+ * ps2_usart.c against simulated PS/2 keyboard
+ *
+ * The device model runs one step per microsecond of _delay_us(). It clocks
+ * in a byte the host sends, acks it and then delivers scripted bytes through
+ * the USART RX interrupt, which fires only while interrupts are enabled.
+ */
+#include "test.h"
+
+volatile uint8_t PORTD, DDRD;
+static uint8_t sim_pin(void);
+
+#define PS2_CLOCK_PORT  PORTD
+#define PS2_CLOCK_PIN   sim_pin()
+#define PS2_CLOCK_DDR   DDRD
+#define PS2_CLOCK_BIT   5
+#define PS2_DATA_PORT   PORTD
+#define PS2_DATA_PIN    sim_pin()
+#define PS2_DATA_DDR    DDRD
+#define PS2_DATA_BIT    2
+
+static bool sim_rx_on = false;
+static uint8_t sim_rx_data;
+#define PS2_USART_INIT()        do { } while (0)
+#define PS2_USART_RX_INT_ON()   (sim_rx_on = true)
+#define PS2_USART_OFF()         (sim_rx_on = false)
+#define PS2_USART_ERROR         0
+#define PS2_USART_RX_DATA       sim_rx_data
+#define PS2_USART_RX_VECT       sim_usart_rx_vect
+
+#include "ps2_usart.c"
+
+
+/* device */
+static enum { DEV_IDLE, DEV_INHIBIT, DEV_RECV, DEV_REPLY } dev_state = DEV_IDLE;
+static bool dev_dead = false;       // ignore request to send
+static uint32_t dev_time;
+static bool dev_clock_low, dev_data_low;
+static uint16_t dev_shift;
+static uint8_t dev_received;
+
+#define REPLY_MAX 8
+static struct { uint32_t at; uint8_t data; } reply[REPLY_MAX];
+static uint8_t reply_len, reply_pos;
+static uint8_t rx_pending[REPLY_MAX];
+static uint8_t rx_pending_len;
+
+static uint32_t sim_us = 0;
+
+static bool host_clock_low(void)
+{
+    return (DDRD & (1<<PS2_CLOCK_BIT)) && !(PORTD & (1<<PS2_CLOCK_BIT));
+}
+static bool host_data_low(void)
+{
+    return (DDRD & (1<<PS2_DATA_BIT)) && !(PORTD & (1<<PS2_DATA_BIT));
+}
+static uint8_t sim_pin(void)
+{
+    uint8_t pin = 0;
+    if (!host_clock_low() && !dev_clock_low) pin |= (1<<PS2_CLOCK_BIT);
+    if (!host_data_low() && !dev_data_low) pin |= (1<<PS2_DATA_BIT);
+    return pin;
+}
+
+static void rx_deliver(void)
+{
+    if (!sim_rx_on || !(SREG & 0x80)) return;
+    for (uint8_t i = 0; i < rx_pending_len; i++) {
+        sim_rx_data = rx_pending[i];
+        sim_usart_rx_vect();
+    }
+    rx_pending_len = 0;
+}
+
+static void dev_step(void)
+{
+    sim_us++;
+    if (sim_us > 2000000) {
+        printf("simulated time exceeded 2s: host hangs\n");
+        exit(1);
+    }
+
+    switch (dev_state) {
+        case DEV_IDLE:
+            if (host_clock_low()) dev_state = DEV_INHIBIT;
+            break;
+        case DEV_INHIBIT:
+            if (host_clock_low()) break;
+            if (!dev_dead && !(sim_pin() & (1<<PS2_DATA_BIT))) {
+                // request to send
+                dev_state = DEV_RECV;
+                dev_time = 0;
+                dev_shift = 0;
+            } else {
+                dev_state = DEV_IDLE;
+            }
+            break;
+        case DEV_RECV:
+            // eleven clocks: low in [40k+20, 40k+40), bit k sampled on rising
+            dev_time++;
+            if (dev_time % 40 == 0 && dev_time <= 400) {
+                if (sim_pin() & (1<<PS2_DATA_BIT)) dev_shift |= 1<<(dev_time/40 - 1);
+            }
+            dev_clock_low = (dev_time < 440 && dev_time % 40 >= 20);
+            dev_data_low = (dev_time >= 405 && dev_time < 440);
+            if (dev_time == 440) {
+                dev_received = dev_shift & 0xFF;
+                dev_state = DEV_REPLY;
+                dev_time = 0;
+                reply_pos = 0;
+            }
+            break;
+        case DEV_REPLY:
+            dev_time++;
+            while (reply_pos < reply_len && reply[reply_pos].at == dev_time) {
+                rx_pending[rx_pending_len++] = reply[reply_pos++].data;
+            }
+            if (reply_pos == reply_len) dev_state = DEV_IDLE;
+            break;
+    }
+    rx_deliver();
+}
+
+void _delay_us(double us)
+{
+    for (uint32_t i = 0; i < (uint32_t)(us + 0.5); i++) dev_step();
+}
+void _delay_ms(double ms)
+{
+    _delay_us(ms * 1000);
+}
+
+static void script(uint8_t n, const uint32_t *at, const uint8_t *data)
+{
+    for (uint8_t i = 0; i < n; i++) {
+        reply[i].at = at[i];
+        reply[i].data = data[i];
+    }
+    reply_len = n;
+}
+
+
+int main(void)
+{
+    uint32_t start;
+    uint8_t res;
+
+    ps2_host_init();
+
+    // normal: ack comes 0.5ms after command
+    script(1, (uint32_t[]){ 500 }, (uint8_t[]){ PS2_ACK });
+    res = ps2_host_send(PS2_SET_LED);
+    CHECK_EQ(dev_received, PS2_SET_LED);
+    CHECK_EQ(res, PS2_ACK);
+    CHECK_EQ(ps2_error, PS2_ERR_NONE);
+    CHECK_EQ(ps2_host_recv(), 0);
+
+    // scan code before ack goes to scan code buffer
+    script(2, (uint32_t[]){ 300, 800 }, (uint8_t[]){ 0x1C, PS2_ACK });
+    res = ps2_host_send(0x02);
+    CHECK_EQ(dev_received, 0x02);
+    CHECK_EQ(res, PS2_ACK);
+    CHECK_EQ(ps2_host_recv(), 0x1C);
+    CHECK_EQ(ps2_host_recv(), 0);
+
+    // extra bytes after ack: scan code and duplicated ack are not responses
+    script(3, (uint32_t[]){ 500, 1500, 2500 }, (uint8_t[]){ PS2_ACK, 0x1C, PS2_ACK });
+    res = ps2_host_send(PS2_SET_TYPEMATIC);
+    CHECK_EQ(res, PS2_ACK);
+    _delay_ms(5);
+    CHECK_EQ(ps2_host_recv(), 0x1C);
+    CHECK_EQ(ps2_host_recv(), PS2_ACK);
+    CHECK_EQ(ps2_host_recv(), 0);
+    CHECK_EQ(expect, 0);
+
+    // echo
+    script(1, (uint32_t[]){ 500 }, (uint8_t[]){ PS2_ECHO });
+    CHECK_EQ(ps2_host_send(PS2_ECHO), PS2_ECHO);
+    CHECK_EQ(dev_received, PS2_ECHO);
+
+    // device never clocks: gives up after 15000 polls(each 1us wait + 1us read)
+    dev_dead = true;
+    start = sim_us;
+    res = ps2_host_send(PS2_ECHO);
+    CHECK_EQ(res, 0);
+    CHECK_EQ(ps2_error, 1);
+    CHECK(sim_us - start < 31000);
+    CHECK_EQ(expect, 0);
+    dev_dead = false;
+
+    // device takes command and stalls: gives up after PS2_RESPONSE_TIMEOUT
+    // and late ack is not taken as response to next command
+    script(1, (uint32_t[]){ 40000 }, (uint8_t[]){ PS2_ACK });
+    start = sim_us;
+    res = ps2_host_send(PS2_SET_LED);
+    CHECK_EQ(res, 0);
+    CHECK_EQ(ps2_error, PS2_ERR_NODATA);
+    CHECK(sim_us - start >= PS2_RESPONSE_TIMEOUT * 1000UL);
+    CHECK(sim_us - start < (PS2_RESPONSE_TIMEOUT + 5) * 1000UL);
+    CHECK_EQ(expect, 0);
+    _delay_ms(20);
+    CHECK_EQ(ps2_host_recv(), PS2_ACK);
+    script(1, (uint32_t[]){ 500 }, (uint8_t[]){ PS2_ECHO });
+    CHECK_EQ(ps2_host_send(PS2_ECHO), PS2_ECHO);
+
+    // async: returns when bits are clocked out, response is polled later
+    script(1, (uint32_t[]){ 2000 }, (uint8_t[]){ PS2_ACK });
+    start = sim_us;
+    CHECK(ps2_host_send_async(PS2_SET_LED));
+    CHECK(sim_us - start < 1500);
+    CHECK_EQ(ps2_host_poll_response(), 0);
+    _delay_ms(3);
+    CHECK_EQ(ps2_host_poll_response(), PS2_ACK);
+    CHECK_EQ(expect, 0);
+
+    // async cancelled: late response goes to scan code buffer
+    script(1, (uint32_t[]){ 2000 }, (uint8_t[]){ PS2_ACK });
+    CHECK(ps2_host_send_async(PS2_SET_LED));
+    ps2_host_cancel_response();
+    _delay_ms(3);
+    CHECK_EQ(ps2_host_poll_response(), 0);
+    CHECK_EQ(ps2_host_recv(), PS2_ACK);
+
+    // async to unplugged keyboard fails
+    dev_dead = true;
+    CHECK(!ps2_host_send_async(PS2_SET_LED));
+    CHECK_EQ(expect, 0);
+    dev_dead = false;
+
+    // interrupts disabled(e.g. before sei() in main): no response can be
+    // received but wait must still be bounded
+    cli();
+    script(1, (uint32_t[]){ 500 }, (uint8_t[]){ PS2_ECHO });
+    start = sim_us;
+    res = ps2_host_send(PS2_ECHO);
+    CHECK_EQ(res, 0);
+    CHECK_EQ(ps2_error, PS2_ERR_NODATA);
+    CHECK(sim_us - start < (PS2_RESPONSE_TIMEOUT + 5) * 1000UL);
+    sei();
+    _delay_us(10);
+    CHECK_EQ(ps2_host_recv(), PS2_ECHO);
+    CHECK_EQ(ps2_host_recv(), 0);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,140 @@
+/*
+ * pjrc/usb_extra.c: report queue against simulated endpoint
+ *
+ * Endpoint takes a report every 10ms like at polling interval of 10ms, system
+ * and consumer key taps come in faster. Host records every usage press and
+ * release it sees per report ID; none may be lost when the queue is full.
+ */
+#include "test.h"
+
+/* endpoint registers: a report is taken when UEINTX is written with 0x3A */
+#define RWAL 5
+static uint8_t UENUM;
+static uint8_t ueintx;
+static uint8_t room;
+static uint8_t data[3];
+static uint8_t data_len;
+static uint16_t host_data[4];       // last usage host took per report ID
+
+static uint8_t host_pressed[0x300]; // presses seen by host per usage
+static uint8_t host_released[0x300];
+
+static void host_take(void)
+{
+    uint16_t usage = data[1] | data[2]<<8;
+    uint16_t last = host_data[data[0]];
+
+    if (usage == last) return;
+    if (last) host_released[last]++;
+    if (usage) host_pressed[usage]++;
+    host_data[data[0]] = usage;
+}
+
+static uint8_t *ueintx_reg(void)
+{
+    if (ueintx == 0x3A) {
+        host_take();
+        data_len = 0;
+        room--;
+    }
+    ueintx = room ? (1<<RWAL) : 0;
+    return &ueintx;
+}
+static uint8_t *uedatx_reg(void)
+{
+    return &data[data_len++ % sizeof(data)];
+}
+#define UEINTX (*ueintx_reg())
+#define UEDATX (*uedatx_reg())
+
+#include "pjrc/usb_extra.c"
+
+
+uint8_t usb_configured(void) { return 1; }
+void idle_rate_restart(uint8_t report_id) { }
+
+
+static uint16_t sof_count = 0;
+
+/* a millisecond: endpoint is taken by host every 10 frames */
+static void run(uint16_t ms)
+{
+    while (ms--) {
+        if (++sof_count % 10 == 0) room = 1;
+        usb_extra_transmit();
+        (void)UEINTX;
+    }
+}
+
+static void reset(void)
+{
+    run(100);
+    memset(host_pressed, 0, sizeof(host_pressed));
+    memset(host_released, 0, sizeof(host_released));
+    usb_extra_overflow = 0;
+}
+
+static const uint16_t usages[] = {
+    AUDIO_VOL_UP, AUDIO_VOL_DOWN, AUDIO_MUTE, TRANSPORT_NEXT_TRACK, TRANSPORT_PLAY_PAUSE,
+};
+#define USAGES (sizeof(usages) / sizeof(usages[0]))
+
+
+int main(void)
+{
+    // consumer taps: press and release 3ms apart, 6ms to next key
+    reset();
+    for (uint8_t i = 0; i < USAGES; i++) {
+        usb_extra_consumer_send(usages[i]);
+        run(3);
+        usb_extra_consumer_send(0);
+        run(6);
+    }
+    run(100);
+    for (uint8_t i = 0; i < USAGES; i++) {
+        CHECK_EQ(host_pressed[usages[i]], 1);
+        CHECK_EQ(host_released[usages[i]], 1);
+    }
+    CHECK_EQ(usb_extra_overflow, 0);
+
+    // release arrives while queue is full
+    reset();
+    room = 0;
+    usb_extra_consumer_send(AUDIO_VOL_UP);
+    usb_extra_consumer_send(0);
+    usb_extra_consumer_send(AUDIO_VOL_DOWN);
+    usb_extra_consumer_send(0);
+    run(100);
+    CHECK_EQ(host_pressed[AUDIO_VOL_UP], 1);
+    CHECK_EQ(host_pressed[AUDIO_VOL_DOWN], 1);
+    CHECK_EQ(host_released[AUDIO_VOL_DOWN], 1);
+    CHECK_EQ(host_data[REPORT_ID_CONSUMER], 0);
+    CHECK_EQ(usb_extra_overflow, 0);
+
+    // system and consumer taps at once while full: press of one is lost,
+    // but last state of both IDs is kept
+    reset();
+    room = 0;
+    usb_extra_system_send(SYSTEM_SLEEP);
+    usb_extra_consumer_send(AUDIO_MUTE);
+    usb_extra_system_send(0);
+    usb_extra_consumer_send(0);
+    run(100);
+    CHECK_EQ(host_pressed[SYSTEM_SLEEP], 1);
+    CHECK_EQ(host_data[REPORT_ID_SYSTEM], 0);
+    CHECK_EQ(host_data[REPORT_ID_CONSUMER], 0);
+    CHECK_EQ(usb_extra_overflow, 1);
+
+    // same key tapped twice while full: a tap can't be kept, last state is
+    reset();
+    room = 0;
+    usb_extra_consumer_send(AUDIO_VOL_UP);
+    usb_extra_consumer_send(0);
+    usb_extra_consumer_send(AUDIO_VOL_UP);
+    usb_extra_consumer_send(0);
+    CHECK_EQ(usb_extra_overflow, 1);
+    run(100);
+    CHECK_EQ(host_data[REPORT_ID_CONSUMER], 0);
+
+    return TEST_RESULT();
+}
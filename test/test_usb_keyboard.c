@@ -0,0 +1,175 @@
+/*
+ * pjrc/usb_keyboard.c: report queue against simulated endpoint
+ *
+ * Endpoint takes a report every 10ms like at polling interval of 10ms and
+ * keeps it for the host, reports come in faster from key events of a fast
+ * roll and taps. Host records every press and release it sees; none may be
+ * lost when the queue is full.
+ */
+#include "test.h"
+
+/* endpoint registers: a report is taken when UEINTX is written with 0x3A */
+#define RWAL 5
+static uint8_t UENUM;
+static uint8_t ueintx;
+static uint8_t room;
+static uint8_t data[8];
+static uint8_t data_len;
+static uint8_t host_keys[8];        // last report host took
+
+static uint8_t host_pressed[256];   // presses seen by host per keycode
+static uint8_t host_released[256];
+
+static void host_take(void)
+{
+    for (uint8_t i = 2; i < 8; i++) {
+        uint8_t code = data[i];
+        if (code && !memchr(host_keys + 2, code, 6)) host_pressed[code]++;
+        code = host_keys[i];
+        if (code && !memchr(data + 2, code, 6)) host_released[code]++;
+    }
+    memcpy(host_keys, data, sizeof(host_keys));
+}
+
+static uint8_t *ueintx_reg(void)
+{
+    if (ueintx == 0x3A) {
+        host_take();
+        data_len = 0;
+        room--;
+    }
+    ueintx = room ? (1<<RWAL) : 0;
+    return &ueintx;
+}
+static uint8_t *uedatx_reg(void)
+{
+    return &data[data_len++ % sizeof(data)];
+}
+#define UEINTX (*ueintx_reg())
+#define UEDATX (*uedatx_reg())
+
+#include "pjrc/usb_keyboard.c"
+
+
+volatile uint16_t usb_sof_count = 0;
+uint8_t usb_configured(void) { return 1; }
+void idle_rate_restart(uint8_t report_id) { }
+
+
+static report_keyboard_t report;
+
+static void add_key(uint8_t code)
+{
+    for (uint8_t i = 0; i < REPORT_KEYS; i++) {
+        if (!report.keys[i]) { report.keys[i] = code; break; }
+    }
+    usb_keyboard_send_report(&report);
+}
+
+static void del_key(uint8_t code)
+{
+    for (uint8_t i = 0; i < REPORT_KEYS; i++) {
+        if (report.keys[i] == code) report.keys[i] = 0;
+    }
+    usb_keyboard_send_report(&report);
+}
+
+/* a millisecond: endpoint is taken by host every 'interval' frames */
+static void sof(uint8_t interval)
+{
+    usb_sof_count++;
+    if (usb_sof_count % interval == 0) room = 1;
+    usb_keyboard_transmit();
+    (void)UEINTX;
+}
+
+static void run(uint16_t ms)
+{
+    while (ms--) sof(10);
+}
+
+static void reset(void)
+{
+    memset(&report, 0, sizeof(report));
+    usb_keyboard_send_report(&report);
+    run(100);
+    memset(host_pressed, 0, sizeof(host_pressed));
+    memset(host_released, 0, sizeof(host_released));
+    usb_keyboard_overflow = 0;
+}
+
+
+int main(void)
+{
+    // roll: next key is pressed before last one is released, event per 3ms
+    // in words of 5 keys
+    reset();
+    for (uint8_t k = KB_A; k < KB_A + 20; k++) {
+        add_key(k);
+        run(3);
+        if (k % 5 != KB_A % 5) { del_key(k - 1); run(3); }
+        if (k % 5 == (KB_A + 4) % 5) { del_key(k); run(100); }
+    }
+    for (uint8_t k = KB_A; k < KB_A + 20; k++) {
+        CHECK_EQ(host_pressed[k], 1);
+        CHECK_EQ(host_released[k], 1);
+    }
+    CHECK_EQ(usb_keyboard_overflow, 0);
+
+    // taps: press and release 3ms apart, 6ms to next key in words of 5 keys
+    reset();
+    for (uint8_t k = KB_A; k < KB_A + 20; k++) {
+        add_key(k);
+        run(3);
+        del_key(k);
+        run(k % 5 == (KB_A + 4) % 5 ? 100 : 6);
+    }
+    run(100);
+    for (uint8_t k = KB_A; k < KB_A + 20; k++) {
+        CHECK_EQ(host_pressed[k], 1);
+        CHECK_EQ(host_released[k], 1);
+    }
+    CHECK_EQ(usb_keyboard_overflow, 0);
+
+    // release arrives while queue is full of key downs
+    reset();
+    room = 0;
+    add_key(KB_A);
+    add_key(KB_B);
+    add_key(KB_C);
+    del_key(KB_A);
+    del_key(KB_B);
+    del_key(KB_C);
+    run(100);
+    CHECK_EQ(host_pressed[KB_A], 1);
+    CHECK_EQ(host_pressed[KB_B], 1);
+    CHECK_EQ(host_pressed[KB_C], 1);
+    CHECK_EQ(host_released[KB_C], 1);
+    CHECK_EQ(usb_keyboard_overflow, 0);
+
+    // modifier tap while key held
+    reset();
+    add_key(KB_X);
+    report.mods = 0x02;
+    usb_keyboard_send_report(&report);
+    report.mods = 0;
+    usb_keyboard_send_report(&report);
+    del_key(KB_X);
+    add_key(KB_Y);
+    run(100);
+    CHECK_EQ(host_pressed[KB_X], 1);
+    CHECK_EQ(host_pressed[KB_Y], 1);
+    CHECK_EQ(usb_keyboard_overflow, 0);
+
+    // queue full of taps only: newest is overwritten, last state kept
+    reset();
+    for (uint8_t k = KB_A; k < KB_A + 6; k++) {
+        add_key(k);
+        del_key(k);
+    }
+    CHECK(usb_keyboard_overflow > 0);
+    run(100);
+    CHECK_EQ(host_keys[2], 0);
+
+    return TEST_RESULT();
+}
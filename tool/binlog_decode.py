@@ -0,0 +1,83 @@
+#!/usr/bin/env python
+#
+# Decoder for deferred-format debug log(BINLOG_ENABLE, see common/binlog.h)
+#
+# Reads format strings from section .binlog of firmware ELF and restores
+# text of '@' lines in debug output. Other lines are passed through.
+#
+# usage: hid_listen | python binlog_decode.py tmk_hhkb_pjrc.elf
+#
+import re
+import struct
+import sys
+
+
+def load_table(elf_path):
+    with open(elf_path, 'rb') as f:
+        elf = bytearray(f.read())
+    if elf[:4] != b'\x7fELF':
+        sys.exit('%s: not ELF file' % elf_path)
+    is64 = (elf[4] == 2)
+    e = '<' if elf[5] == 1 else '>'
+    if is64:
+        shoff, = struct.unpack_from(e + 'Q', elf, 0x28)
+        shentsize, shnum, shstrndx = struct.unpack_from(e + 'HHH', elf, 0x3A)
+        fmt, name_i, off_i, size_i = e + 'IIQQQQ', 0, 4, 5
+    else:
+        shoff, = struct.unpack_from(e + 'I', elf, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from(e + 'HHH', elf, 0x2E)
+        fmt, name_i, off_i, size_i = e + 'IIIIII', 0, 4, 5
+
+    sections = [struct.unpack_from(fmt, elf, shoff + i * shentsize) for i in range(shnum)]
+    strtab = sections[shstrndx]
+    for sh in sections:
+        n = strtab[off_i] + sh[name_i]
+        name = elf[n:elf.index(b'\0', n)]
+        if name == b'.binlog':
+            return elf[sh[off_i]:sh[off_i] + sh[size_i]]
+    sys.exit('%s: no .binlog section, built without BINLOG_ENABLE?' % elf_path)
+
+
+SPEC = re.compile(r'%(\d*)([Xb%])')
+
+def format_line(table, id, args):
+    if id >= len(table):
+        return '<binlog: unknown id %04X>\n' % id
+    end = table.index(b'\0', id)
+    text = table[id:end].decode('ascii', 'replace')
+    args = list(args)
+
+    def conv(m):
+        width, kind = m.group(1), m.group(2)
+        if kind == '%':
+            return '%'
+        v = args.pop(0) if args else 0
+        if kind == 'b':
+            return format(v & 0xFF, '08b')
+        if width and int(width) > 2:
+            return '%04X' % (v & 0xFFFF)
+        return '%02X' % (v & 0xFF)
+    return SPEC.sub(conv, text)
+
+
+RECORD = re.compile(r'@([0-9A-F]{4})((?:[0-9A-F]{4}){0,2})\s*$')
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit('usage: %s <elf> [log]' % sys.argv[0])
+    table = load_table(sys.argv[1])
+    src = open(sys.argv[2]) if len(sys.argv) > 2 else sys.stdin
+    for line in src:
+        m = RECORD.search(line)
+        if not m:
+            sys.stdout.write(line)
+            continue
+        sys.stdout.write(line[:m.start()])
+        a = m.group(2)
+        args = [int(a[i:i + 4], 16) for i in range(0, len(a), 4)]
+        sys.stdout.write(format_line(table, int(m.group(1), 16), args))
+        sys.stdout.flush()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,123 @@
+#!/usr/bin/env python
+#
+# Keymap packer for KEYMAP_PACK_ENABLE(see common/keymap_pack.h)
+#
+# Reads dense keymaps[layers][MATRIX_ROWS][MATRIX_COLS] from object file of
+# common/keymap_dense.c(keymap.c with -DKEYMAP_PACK_DENSE) and writes packed
+# keymap. Only keys other than KB_NO are stored on base layer, and only keys
+# different from base layer on other layers. A layer which has KB_TRNS keys
+# stores only its other keys instead.
+#
+# usage: python keymap_pack.py keymap_dense.o keymap_packed.c
+#
+import struct
+import sys
+
+
+def load_symbols(obj_path, names):
+    with open(obj_path, 'rb') as f:
+        elf = bytearray(f.read())
+    if elf[:4] != b'\x7fELF' or elf[4] != 1:
+        sys.exit('%s: not ELF32 file' % obj_path)
+    e = '<' if elf[5] == 1 else '>'
+    shoff, = struct.unpack_from(e + 'I', elf, 0x20)
+    shentsize, shnum, shstrndx = struct.unpack_from(e + 'HHH', elf, 0x2E)
+    # name, type, flags, addr, offset, size, link, info, addralign, entsize
+    sections = [struct.unpack_from(e + 'IIIIIIIIII', elf, shoff + i * shentsize)
+                for i in range(shnum)]
+
+    found = {}
+    for sh in sections:
+        if sh[1] != 2:      # SHT_SYMTAB
+            continue
+        strtab = sections[sh[6]]
+        for off in range(sh[4], sh[4] + sh[5], 16):
+            st_name, st_value, st_size, st_info, st_other, st_shndx = \
+                struct.unpack_from(e + 'IIIBBH', elf, off)
+            n = strtab[4] + st_name
+            name = elf[n:elf.index(b'\0', n)].decode('ascii')
+            if name in names and 0 < st_shndx < shnum:
+                data = sections[st_shndx][4] + st_value
+                found[name] = elf[data:data + st_size]
+    for name in names:
+        if name not in found:
+            sys.exit('%s: no symbol %s' % (obj_path, name))
+    return found
+
+
+KB_NO = 0x00
+KB_TRNS = 0xDF
+PACK_TRNS = 0x8000      # KEYMAP_PACK_TRNS
+
+
+def pack(keymaps, rows, cols):
+    layer_size = rows * cols
+    layers = len(keymaps) // layer_size
+    base = keymaps[:layer_size]
+
+    starts, bits, offsets, codes = [], [], [], []
+    for l in range(layers):
+        layer = keymaps[l * layer_size:(l + 1) * layer_size]
+        # key not stored: KB_NO on base, KB_TRNS or same as base on others
+        if l == 0:
+            omit, trns = [KB_NO] * layer_size, False
+        elif KB_TRNS in layer:
+            omit, trns = [KB_TRNS] * layer_size, True
+        else:
+            omit, trns = base, False
+        starts.append(len(codes) | (PACK_TRNS if trns else 0))
+        n = 0
+        for r in range(rows):
+            b = 0
+            offsets.append(n)
+            for c in range(cols):
+                code = layer[r * cols + c]
+                if code != omit[r * cols + c]:
+                    b |= 1 << c
+                    codes.append(code)
+                    n += 1
+            bits.append(b)
+    return layers, starts, bits, offsets, codes
+
+
+def c_array(values, fmt, per_line):
+    lines = []
+    for i in range(0, len(values), per_line):
+        lines.append('    ' + ', '.join(fmt % v for v in values[i:i + per_line]) + ',')
+    return '\n'.join(lines)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit('usage: %s <keymap_dense.o> <keymap_packed.c>' % sys.argv[0])
+    syms = load_symbols(sys.argv[1], ('keymaps', 'keymap_pack_dims'))
+    rows, cols = syms['keymap_pack_dims'][0], syms['keymap_pack_dims'][1]
+    keymaps = syms['keymaps']
+    layers, starts, bits, offsets, codes = pack(keymaps, rows, cols)
+    if max(offsets) > 255:
+        sys.exit('keymap_pack: too many keys in a layer')
+    if len(codes) >= PACK_TRNS:
+        sys.exit('keymap_pack: too many keys')
+
+    bits_size = 1 if cols <= 8 else 2
+    packed = layers * 2 + len(bits) * bits_size + len(offsets) + len(codes)
+    with open(sys.argv[2], 'w') as f:
+        f.write('/* Generated by tool/keymap_pack.py. Do not edit. */\n')
+        f.write('#include <stdint.h>\n')
+        f.write('#include <avr/pgmspace.h>\n')
+        f.write('#include "keymap_pack.h"\n\n')
+        f.write('const uint16_t PROGMEM keymap_pack_start[] = {\n%s\n};\n'
+                % c_array(starts, '0x%04X', 8))
+        f.write('const keymap_pack_row_t PROGMEM keymap_pack_bits[][MATRIX_ROWS] = {\n%s\n};\n'
+                % c_array(bits, '0x%02X' if bits_size == 1 else '0x%04X', rows))
+        f.write('const uint8_t PROGMEM keymap_pack_offset[][MATRIX_ROWS] = {\n%s\n};\n'
+                % c_array(offsets, '%d', rows))
+        f.write('const uint8_t PROGMEM keymap_pack_codes[] = {\n%s\n};\n'
+                % c_array(codes, '0x%02X', 16))
+
+    print('keymap_pack: %d layers, dense %d bytes, packed %d bytes, saved %d bytes'
+          % (layers, len(keymaps), packed, len(keymaps) - packed))
+
+
+if __name__ == '__main__':
+    main()